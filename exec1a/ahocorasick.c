@@ -0,0 +1,261 @@
+/**
+ * @file ahocorasick.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Construction and scanning of the Aho-Corasick automaton.
+ *
+ * The keywords are inserted into a trie whose rows are already dense. A breadth-first
+ * pass computes the failure links and replaces every missing transition by the one of
+ * the failure state, so the finished table is a complete DFA: scanning costs one table
+ * load and one sign test per input byte, independent of the number of keywords.
+ */
+
+#include "ahocorasick.h"
+
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AC_X86 1
+#include <immintrin.h>
+#endif
+
+/** Kernels for skipping bytes that cannot start a keyword. */
+#define SKIP_SCALAR 0
+#define SKIP_SSSE3 1
+#define SKIP_AVX2 2
+
+/**
+ * @brief Assigns a byte class to every byte that occurs in a keyword.
+ *
+ * @return Number of classes, including class 0 for all other bytes.
+ */
+static int32_t build_classes(ac_t *ac, char *const keywords[], int count, bool nocase) {
+    int32_t next = 1;
+    int i = 0;
+
+    memset(ac->classes, 0, sizeof(ac->classes));
+    for (; i < count; i++) {
+        const unsigned char *k = (const unsigned char *)keywords[i];
+        for (; *k != '\0'; k++) {
+            unsigned char c = nocase ? (unsigned char)tolower(*k) : *k;
+            if (ac->classes[c] != 0) continue;
+            ac->classes[c] = (uint8_t)next;
+            if (nocase && isalpha(c)) ac->classes[toupper(c)] = (uint8_t)next;
+            next++;
+        }
+    }
+    return next;
+}
+
+/**
+ * @brief Records the bytes that can start a keyword and builds the nibble tables for the
+ * vectorized skip, if the set allows it.
+ */
+static void build_starts(ac_t *ac, char *const keywords[], int count, bool nocase) {
+    int buckets[16];
+    int nbuckets = 0, i = 0, c;
+
+    memset(ac->starts, 0, sizeof(ac->starts));
+    memset(ac->start_lo, 0, sizeof(ac->start_lo));
+    memset(ac->start_hi, 0, sizeof(ac->start_hi));
+    for (; i < count; i++) {
+        unsigned char first = (unsigned char)keywords[i][0];
+        ac->starts[first] = 1;
+        if (nocase) {
+            ac->starts[tolower(first)] = 1;
+            ac->starts[toupper(first)] = 1;
+        }
+    }
+
+    for (i = 0; i < 16; i++) buckets[i] = -1;
+    for (c = 0; c < 256; c++) {
+        if (!ac->starts[c]) continue;
+        if (buckets[c >> 4] == -1) buckets[c >> 4] = nbuckets++;
+    }
+    ac->skip = SKIP_SCALAR;
+    if (nbuckets > 8) return;
+    for (c = 0; c < 256; c++) {
+        if (!ac->starts[c]) continue;
+        ac->start_hi[c >> 4] = (uint8_t)(1 << buckets[c >> 4]);
+        ac->start_lo[c & 15] |= (uint8_t)(1 << buckets[c >> 4]);
+    }
+#ifdef AC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) ac->skip = SKIP_AVX2;
+    else if (__builtin_cpu_supports("ssse3")) ac->skip = SKIP_SSSE3;
+#endif
+}
+
+#ifdef AC_X86
+
+/**
+ * @brief Skips to the next byte in the start set, 16 bytes at a time.
+ */
+__attribute__((target("ssse3")))
+static const unsigned char *skip_ssse3(const ac_t *ac, const unsigned char *p, const unsigned char *end) {
+    const __m128i lo = _mm_loadu_si128((const __m128i *)ac->start_lo);
+    const __m128i hi = _mm_loadu_si128((const __m128i *)ac->start_hi);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+
+    for (; p + 16 <= end; p += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)p);
+        __m128i in = _mm_and_si128(_mm_shuffle_epi8(lo, _mm_and_si128(b, nibble)),
+                                   _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(b, 4), nibble)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(in, _mm_setzero_si128())) ^ 0xFFFF;
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    while (p < end && !ac->starts[*p]) p++;
+    return p;
+}
+
+/**
+ * @brief Skips to the next byte in the start set, 32 bytes at a time.
+ */
+__attribute__((target("avx2")))
+static const unsigned char *skip_avx2(const ac_t *ac, const unsigned char *p, const unsigned char *end) {
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)ac->start_lo));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)ac->start_hi));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    for (; p + 32 <= end; p += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *)p);
+        __m256i in = _mm256_and_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(b, nibble)),
+                                      _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble)));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(in, _mm256_setzero_si256()));
+        if (mask != 0) return p + __builtin_ctz(mask);
+    }
+    return skip_ssse3(ac, p, end);
+}
+
+#endif
+
+/**
+ * @brief Returns the first position in [p, end) that holds a byte which can start a keyword.
+ */
+static inline const unsigned char *skip_start(const ac_t *ac, const unsigned char *p, const unsigned char *end) {
+#ifdef AC_X86
+    if (ac->skip == SKIP_AVX2) return skip_avx2(ac, p, end);
+    if (ac->skip == SKIP_SSSE3) return skip_ssse3(ac, p, end);
+#endif
+    while (p < end && !ac->starts[*p]) p++;
+    return p;
+}
+
+/**
+ * @brief Builds the trie, the failure links and the final dense transition table.
+ */
+const char *ac_compile(ac_t *ac, char *const keywords[], int count, bool nocase) {
+    size_t maxstates = 1;
+    int32_t *fail, *queue;
+    int32_t head = 0, tail = 0, s, c;
+    int i = 0;
+
+    ac->empty = false;
+    for (; i < count; i++) {
+        maxstates += strlen(keywords[i]);
+        if (keywords[i][0] == '\0') ac->empty = true;
+    }
+    ac->nclasses = build_classes(ac, keywords, count, nocase);
+    build_starts(ac, keywords, count, nocase);
+    if (maxstates * (size_t)ac->nclasses > INT32_MAX) return "keyword set too large";
+
+    ac->table = malloc(maxstates * ac->nclasses * sizeof(*ac->table));
+    ac->outlen = malloc(maxstates * sizeof(*ac->outlen));
+    fail = malloc(maxstates * sizeof(*fail));
+    queue = malloc(maxstates * sizeof(*queue));
+    if (ac->table == NULL || ac->outlen == NULL || fail == NULL || queue == NULL) {
+        free(queue);
+        free(fail);
+        ac_free(ac);
+        return "out of memory";
+    }
+    for (s = 0; s < (int32_t)(maxstates * ac->nclasses); s++) ac->table[s] = -1;
+    memset(ac->outlen, 0, maxstates * sizeof(*ac->outlen));
+
+    /* trie */
+    ac->nstates = 1;
+    for (i = 0; i < count; i++) {
+        const unsigned char *k = (const unsigned char *)keywords[i];
+        int32_t state = 0, depth = 0;
+        for (; *k != '\0'; k++, depth++) {
+            int32_t *slot = &ac->table[state * ac->nclasses + ac->classes[*k]];
+            if (*slot == -1) *slot = ac->nstates++;
+            state = *slot;
+        }
+        if (depth > ac->outlen[state]) ac->outlen[state] = depth;
+    }
+
+    /* failure links in breadth-first order, missing transitions are taken from the failure state */
+    fail[0] = 0;
+    for (c = 0; c < ac->nclasses; c++) {
+        int32_t *slot = &ac->table[c];
+        if (*slot == -1) {
+            *slot = 0;
+        } else {
+            fail[*slot] = 0;
+            queue[tail++] = *slot;
+        }
+    }
+    while (head < tail) {
+        int32_t state = queue[head++];
+        if (ac->outlen[fail[state]] > ac->outlen[state]) ac->outlen[state] = ac->outlen[fail[state]];
+        for (c = 0; c < ac->nclasses; c++) {
+            int32_t *slot = &ac->table[state * ac->nclasses + c];
+            int32_t via_fail = ac->table[fail[state] * ac->nclasses + c];
+            if (*slot == -1) {
+                *slot = via_fail;
+            } else {
+                fail[*slot] = via_fail;
+                queue[tail++] = *slot;
+            }
+        }
+    }
+
+    /* premultiply targets and mark accepting targets by their sign */
+    for (s = 0; s < ac->nstates * ac->nclasses; s++) {
+        int32_t target = ac->table[s];
+        ac->table[s] = ac->outlen[target] > 0 ? -(target * ac->nclasses) : target * ac->nclasses;
+    }
+
+    free(queue);
+    free(fail);
+    return NULL;
+}
+
+/**
+ * @brief Runs the automaton until the first accepting state is reached.
+ *
+ * @details Whenever the automaton is back in the start state, all bytes that cannot start
+ * a keyword leave it there, so they are skipped without table lookups.
+ */
+const char *ac_find(const ac_t *ac, const char *hay, size_t len) {
+    const unsigned char *p = (const unsigned char *)hay;
+    const unsigned char *end = p + len;
+    const int32_t *table = ac->table;
+    int32_t state = 0;
+
+    if (ac->empty) return hay;
+    for (; p < end; p++) {
+        int32_t next;
+        if (state == 0 && (p = skip_start(ac, p, end)) == end) break;
+        next = table[state + ac->classes[*p]];
+        if (next < 0) {
+            state = -next;
+            return (const char *)p + 1 - ac->outlen[state / ac->nclasses];
+        }
+        state = next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Frees the transition and output tables.
+ */
+void ac_free(ac_t *ac) {
+    free(ac->table);
+    free(ac->outlen);
+    ac->table = NULL;
+    ac->outlen = NULL;
+}
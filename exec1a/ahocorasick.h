@@ -0,0 +1,74 @@
+#ifndef AHOCORASICK_H
+#define AHOCORASICK_H
+/**
+ * @file ahocorasick.h
+ * @brief Aho-Corasick automaton for searching many keywords in one pass.
+ *
+ * All keywords are compiled into a deterministic automaton with a dense transition
+ * table. Input bytes are first mapped to a small set of byte classes (every byte that
+ * occurs in a keyword gets its own class, all other bytes share class 0), which keeps a
+ * table row short enough to stay in cache even for thousands of keywords.
+ *
+ * While the automaton is in its start state, the input is skipped with a vectorized
+ * byte-set scan up to the next byte that can start a keyword.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @struct ac
+ * @brief A compiled keyword set.
+ *
+ * @details `table` holds `nstates * nclasses` entries. An entry is the target state
+ * multiplied by `nclasses`, so it can be used as the next row offset directly, and it is
+ * negated if the target state ends a keyword. `outlen` gives, per state, the length of
+ * the longest keyword ending there. With case folding both cases of a letter share one
+ * byte class, so the input is never folded.
+ *
+ * `starts` flags the bytes that can start a keyword. If their high nibbles fit into eight
+ * buckets, `start_lo`/`start_hi` encode the same set as two nibble tables for `pshufb`,
+ * and `skip` selects the kernel used to skip over all other bytes.
+ */
+typedef struct ac {
+    int32_t *table;
+    int32_t *outlen;
+    uint8_t classes[256];
+    int32_t nclasses;
+    int32_t nstates;
+    bool empty;
+    uint8_t starts[256];
+    uint8_t start_lo[16];
+    uint8_t start_hi[16];
+    int skip;
+} ac_t;
+
+/**
+ * @brief Builds the automaton for `count` keywords.
+ *
+ * @param ac The automaton to initialise.
+ * @param keywords The keywords, NUL-terminated.
+ * @param count Number of keywords.
+ * @param nocase If true, ASCII letters match regardless of their case.
+ * @return NULL on success, otherwise a message saying the keyword set is too large or
+ * memory ran out; nothing has to be freed then.
+ */
+const char *ac_compile(ac_t *ac, char *const keywords[], int count, bool nocase);
+
+/**
+ * @brief Finds the keyword occurrence that ends first in `hay`.
+ *
+ * @param ac A compiled automaton.
+ * @param hay Start of the bytes to scan.
+ * @param len Number of bytes to scan.
+ * @return Pointer to the first byte of the match, or NULL if no keyword occurs.
+ */
+const char *ac_find(const ac_t *ac, const char *hay, size_t len);
+
+/**
+ * @brief Releases the memory held by an automaton.
+ */
+void ac_free(ac_t *ac);
+
+#endif // AHOCORASICK_H
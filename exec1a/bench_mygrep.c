@@ -0,0 +1,261 @@
+/**
+ * @file bench_mygrep.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief End-to-end throughput benchmark of the `mygrep` binary.
+ *
+ * Runs `mygrep` in several modes over a corpus made by `gencorpus` and reports MB/s and
+ * lines/s of input for each one; the time includes process start, reading the input and
+ * writing the matching lines to `/dev/null`. Every mode runs `ROUNDS` times and the fastest
+ * run counts, which hides most of the noise of a shared machine. Before timing, each mode
+ * is run once with `-c` to check that it finds the same number of matching lines as the
+ * plain search of the same input.
+ *
+ * Usage: bench_mygrep [-k keyword] [-j threads] mygrep single-file corpus-dir
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#define ROUNDS 5
+#define MAX_ARGS 16
+#define DEFAULT_KEYWORD "needle"
+
+extern char **environ;
+
+/**
+ * @struct corpus
+ * @brief Input of a benchmark mode: file paths and their total size in bytes and lines.
+ */
+typedef struct corpus {
+    char **paths;
+    int count;
+    size_t bytes;
+    size_t lines;
+} corpus_t;
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *myprog) {
+    fprintf(stderr, "Usage: %s [-k keyword] [-j threads] mygrep single-file corpus-dir\n", myprog);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Adds a file to a corpus and counts its bytes and lines.
+ */
+static void add_file(corpus_t *c, const char *path) {
+    char buf[1 << 16];
+    char **grown = realloc(c->paths, (c->count + 2) * sizeof(*grown));
+    FILE *in = fopen(path, "r");
+    size_t n;
+
+    if (grown == NULL || (grown[c->count] = strdup(path)) == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    if (in == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    c->paths = grown;
+    c->paths[++c->count] = NULL;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        const char *p = buf, *end = buf + n;
+        c->bytes += n;
+        while ((p = memchr(p, '\n', end - p)) != NULL) {
+            c->lines++;
+            p++;
+        }
+    }
+    fclose(in);
+}
+
+static int is_file(const struct dirent *d) {
+    return d->d_name[0] != '.';
+}
+
+/**
+ * @brief Collects the files of a corpus directory in sorted order.
+ */
+static void add_dir(corpus_t *c, const char *dir) {
+    struct dirent **names;
+    int n = scandir(dir, &names, is_file, alphasort), i = 0;
+
+    if (n == -1) {
+        perror(dir);
+        exit(EXIT_FAILURE);
+    }
+    for (; i < n; i++) {
+        char *path = malloc(strlen(dir) + strlen(names[i]->d_name) + 2);
+        if (path == NULL) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        sprintf(path, "%s/%s", dir, names[i]->d_name);
+        add_file(c, path);
+        free(path);
+        free(names[i]);
+    }
+    free(names);
+}
+
+/**
+ * @brief Runs `mygrep` once and waits for it.
+ *
+ * @param args Arguments up to (excluding) the input files, NULL-terminated.
+ * @param c Input files, passed as arguments, or NULL.
+ * @param stdin_path File to connect to standard input, or NULL.
+ * @param capture File descriptor that receives standard output, or -1 for `/dev/null`.
+ * @return Wall-clock time of the run in seconds.
+ */
+static double run(char *const args[], const corpus_t *c, const char *stdin_path, int capture) {
+    char *argv[MAX_ARGS + 1024];
+    posix_spawn_file_actions_t actions;
+    int argc = 0, i = 0, status;
+    double t;
+    pid_t pid;
+
+    for (; args[argc] != NULL; argc++) argv[argc] = args[argc];
+    for (; c != NULL && i < c->count && argc < MAX_ARGS + 1023; i++) argv[argc++] = c->paths[i];
+    argv[argc] = NULL;
+
+    posix_spawn_file_actions_init(&actions);
+    if (stdin_path != NULL) posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, stdin_path, O_RDONLY, 0);
+    if (capture >= 0) posix_spawn_file_actions_adddup2(&actions, capture, STDOUT_FILENO);
+    else posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    t = now();
+    if (posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0) {
+        perror(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    t = now() - t;
+    posix_spawn_file_actions_destroy(&actions);
+    return t;
+}
+
+/**
+ * @brief Returns the total number of matching lines reported by `mygrep -c`.
+ */
+static long count_matches(char *const args[], const corpus_t *c, const char *stdin_path) {
+    char *counted[MAX_ARGS + 1];
+    char line[4096];
+    FILE *out = tmpfile();
+    long total = 0;
+    int n = 0, skip = 0;
+
+    if (out == NULL) {
+        perror("tmpfile");
+        exit(EXIT_FAILURE);
+    }
+    for (; args[n] != NULL && n < MAX_ARGS - 1; n++) {
+        counted[n] = args[n];
+        if (strcmp(args[n], "-c") == 0) skip = 1;
+    }
+    counted[n] = NULL;
+    if (!skip) {
+        /* insert -c behind the program name */
+        memmove(counted + 2, counted + 1, n * sizeof(*counted));
+        counted[1] = "-c";
+    }
+    run(counted, stdin_path != NULL ? NULL : c, stdin_path, fileno(out));
+
+    rewind(out);
+    while (fgets(line, sizeof(line), out) != NULL) {
+        char *colon = strrchr(line, ':');
+        total += atol(colon != NULL ? colon + 1 : line);
+    }
+    fclose(out);
+    return total;
+}
+
+/**
+ * @brief Checks and times one mode and prints its throughput.
+ */
+static void bench(const char *name, char *const args[], const corpus_t *c, const char *stdin_path, long expected) {
+    long matches = count_matches(args, c, stdin_path);
+    double best = 1e30;
+    int r = 0;
+
+    for (; r < ROUNDS; r++) {
+        double t = run(args, stdin_path != NULL ? NULL : c, stdin_path, -1);
+        if (t < best) best = t;
+    }
+    printf("  %-14s %9.1f MB/s %12.0f lines/s %10ld matches%s\n", name, c->bytes / best / 1e6, c->lines / best,
+           matches, expected >= 0 && matches != expected ? "  MISMATCH" : "");
+}
+
+/**
+ * @brief Benchmarks all modes.
+ *
+ * @param argc Argument count.
+ * @param argv Options, the `mygrep` binary, a single corpus file and a corpus directory.
+ * @return EXIT_SUCCESS.
+ */
+int main(int argc, char *argv[]) {
+    corpus_t single = { NULL, 0, 0, 0 }, multi = { NULL, 0, 0, 0 };
+    char *keyword = DEFAULT_KEYWORD, *threads = "4";
+    long plain, all;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "k:j:")) != -1) {
+        switch (opt) {
+        case 'k': keyword = optarg; break;
+        case 'j': threads = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 3) usage(argv[0]);
+    add_file(&single, argv[optind + 1]);
+    add_dir(&multi, argv[optind + 2]);
+    if (multi.count > 1000) {
+        fprintf(stderr, "%s: at most 1000 files are supported\n", argv[optind + 2]);
+        exit(EXIT_FAILURE);
+    }
+
+    {
+        char *mygrep = argv[optind];
+        char *plain_args[] = { mygrep, keyword, NULL };
+        char *nocase_args[] = { mygrep, "-i", keyword, NULL };
+        char *regex_args[] = { mygrep, "-E", keyword, NULL };
+        char *count_args[] = { mygrep, "-c", keyword, NULL };
+        char *parallel_args[] = { mygrep, "-j", threads, keyword, NULL };
+
+        printf("%s: %zu bytes, %zu lines\n", argv[optind + 1], single.bytes, single.lines);
+        plain = count_matches(plain_args, &single, NULL);
+        bench("plain", plain_args, &single, NULL, plain);
+        bench("-i", nocase_args, &single, NULL, -1);
+        bench("-E", regex_args, &single, NULL, plain);
+        bench("-c", count_args, &single, NULL, plain);
+        bench("stdin", plain_args, &single, single.paths[0], plain);
+        bench("-j", parallel_args, &single, NULL, plain);
+
+        printf("%s: %d files, %zu bytes, %zu lines\n", argv[optind + 2], multi.count, multi.bytes, multi.lines);
+        all = count_matches(plain_args, &multi, NULL);
+        bench("multi-file", plain_args, &multi, NULL, all);
+        bench("multi-file -i", nocase_args, &multi, NULL, -1);
+        bench("multi-file -j", parallel_args, &multi, NULL, all);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,191 @@
+/**
+ * @file bench_search.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Micro-benchmark comparing the `search_find()` kernels against libc `strstr()`.
+ *
+ * A synthetic log-like corpus is generated in memory and split into lines. Every line is
+ * searched individually, the same way `readLine()` does it, for needles of several
+ * lengths. Throughput is printed in MB/s together with the number of matching lines, which
+ * must be identical for all implementations. A second pass searches the whole corpus as one
+ * buffer, which is how the kernels are used on memory-mapped input, and compares against
+ * `memmem()`.
+ *
+ * Usage: bench_search [megabytes]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "search.h"
+
+#define DEFAULT_MB 64
+#define ROUNDS 3
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+/**
+ * @brief Deterministic xorshift generator, so every run searches the same corpus.
+ */
+static unsigned long long next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Fills `buf` with NUL-terminated lines of random lower-case words.
+ *
+ * @param buf Destination buffer.
+ * @param size Size of the buffer.
+ * @param starts Receives the offset of every line, must have room for `size / 2` entries.
+ * @return Number of lines written.
+ */
+static size_t make_corpus(char *buf, size_t size, size_t *starts) {
+    size_t pos = 0, lines = 0;
+
+    while (pos + 200 < size) {
+        size_t linelen = 40 + next_random() % 120;
+        size_t i = 0;
+        starts[lines++] = pos;
+        for (; i < linelen; i++) {
+            buf[pos++] = (next_random() % 6 == 0) ? ' ' : (char)('a' + next_random() % 26);
+        }
+        buf[pos++] = '\n';
+        buf[pos++] = '\0';
+    }
+    starts[lines] = pos;
+    return lines;
+}
+
+/**
+ * @brief Searches every line with `strstr()` and reports the throughput.
+ */
+static void run_strstr(const char *buf, const size_t *starts, size_t lines, size_t bytes, const char *needle) {
+    size_t hits = 0, r, i;
+    double best = 1e30;
+
+    for (r = 0; r < ROUNDS; r++) {
+        double t = now();
+        hits = 0;
+        for (i = 0; i < lines; i++) {
+            if (strstr(buf + starts[i], needle) != NULL) hits++;
+        }
+        t = now() - t;
+        if (t < best) best = t;
+    }
+    printf("  %-8s %10.1f MB/s  %8zu hits\n", "strstr", bytes / best / 1e6, hits);
+}
+
+/**
+ * @brief Searches every line with `search_find()` using `kernel` and reports the throughput.
+ */
+static void run_kernel(const char *buf, const size_t *starts, size_t lines, size_t bytes, searcher_t *s, search_kernel_t kernel) {
+    size_t hits = 0, r, i;
+    double best = 1e30;
+
+    if (!search_set_kernel(s, kernel)) return;
+    for (r = 0; r < ROUNDS; r++) {
+        double t = now();
+        hits = 0;
+        for (i = 0; i < lines; i++) {
+            size_t len = starts[i + 1] - starts[i] - 1;
+            if (search_find(s, buf + starts[i], len) != NULL) hits++;
+        }
+        t = now() - t;
+        if (t < best) best = t;
+    }
+    printf("  %-8s %10.1f MB/s  %8zu hits\n", search_kernel_name(kernel), bytes / best / 1e6, hits);
+}
+
+/**
+ * @brief Counts all occurrences in the whole corpus, with `memmem()` if `s` is NULL.
+ */
+static void run_whole(const char *buf, size_t bytes, searcher_t *s, search_kernel_t kernel, const char *needle) {
+    size_t hits = 0, r, len = strlen(needle);
+    double best = 1e30;
+
+    if (s != NULL && !search_set_kernel(s, kernel)) return;
+    for (r = 0; r < ROUNDS; r++) {
+        const char *p = buf, *end = buf + bytes;
+        double t = now();
+        hits = 0;
+        while ((p = s != NULL ? search_find(s, p, end - p) : memmem(p, end - p, needle, len)) != NULL) {
+            hits++;
+            p++;
+        }
+        t = now() - t;
+        if (t < best) best = t;
+    }
+    printf("  %-8s %10.1f MB/s  %8zu hits (whole buffer)\n", s != NULL ? search_kernel_name(kernel) : "memmem",
+           bytes / best / 1e6, hits);
+}
+
+/**
+ * @brief Generates the corpus and benchmarks every needle length.
+ *
+ * @param argc Argument count.
+ * @param argv Optional corpus size in megabytes.
+ * @return EXIT_SUCCESS.
+ */
+int main(int argc, char *argv[]) {
+    static const size_t needle_lengths[] = { 2, 3, 4, 6, 8, 12, 16, 32, 64 };
+    size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MB;
+    size_t size = (mb > 0 ? mb : DEFAULT_MB) * 1024 * 1024;
+    char *buf = malloc(size);
+    size_t *starts = malloc((size / 2 + 1) * sizeof(*starts));
+    size_t lines, n;
+
+    if (buf == NULL || starts == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    lines = make_corpus(buf, size, starts);
+    printf("corpus: %zu lines, %zu bytes\n", lines, starts[lines]);
+
+    for (n = 0; n < sizeof(needle_lengths) / sizeof(needle_lengths[0]); n++) {
+        char needle[65];
+        size_t len = needle_lengths[n], i;
+        searcher_t s;
+
+        /* take the needle from the corpus, so the short ones actually match sometimes */
+        size_t line = next_random() % lines;
+        for (i = 0; i < len; i++) {
+            char c = buf[starts[line] + i];
+            needle[i] = (c == ' ' || c == '\n' || c == '\0') ? 'q' : c;
+        }
+        needle[len] = '\0';
+
+        printf("needle length %zu \"%s\"\n", len, needle);
+        if (search_compile(&s, needle, len, false) != NULL) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        run_strstr(buf, starts, lines, starts[lines], needle);
+        run_kernel(buf, starts, lines, starts[lines], &s, SEARCH_SCALAR);
+        run_kernel(buf, starts, lines, starts[lines], &s, SEARCH_SSE2);
+        run_kernel(buf, starts, lines, starts[lines], &s, SEARCH_AVX2);
+        run_whole(buf, starts[lines], NULL, SEARCH_SCALAR, needle);
+        run_whole(buf, starts[lines], &s, SEARCH_SSE2, needle);
+        run_whole(buf, starts[lines], &s, SEARCH_AVX2, needle);
+        search_free(&s);
+    }
+
+    free(starts);
+    free(buf);
+    exit(EXIT_SUCCESS);
+}
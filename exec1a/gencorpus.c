@@ -0,0 +1,246 @@
+/**
+ * @file gencorpus.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Synthetic corpus generator for the `mygrep` benchmarks.
+ *
+ * Writes lines of random words with a chosen line length distribution. A chosen fraction
+ * of the lines contains the keyword at a random position, and a chosen fraction of all
+ * words (the inserted keywords included) is written in random mixed case, which is what
+ * makes `-i` searches expensive. The filler words are built from an alphabet without the
+ * first letter of the keyword, so the filler never matches by accident and the number of
+ * matching lines is known exactly; it is printed at the end.
+ *
+ * Usage: gencorpus [-s megabytes] [-n files] [-l mean] [-L max] [-d fixed|uniform|exp]
+ *                  [-m density] [-c casemix] [-k keyword] [-S seed] output
+ *
+ * With one file `output` is the file, with several it is a directory that receives
+ * `corpus-000.txt`, `corpus-001.txt` and so on, together `megabytes` in size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DEFAULT_KEYWORD "needle"
+
+/**
+ * @enum LENGTH_DIST
+ * @brief Distribution of the line lengths around the mean.
+ */
+typedef enum LENGTH_DIST {
+    DIST_FIXED,     /**< every line has the mean length */
+    DIST_UNIFORM,   /**< uniform between 1 and twice the mean */
+    DIST_EXP        /**< exponential with the given mean, many short and few long lines */
+} length_dist_t;
+
+/**
+ * @struct corpus_opts
+ * @brief Shape of the generated corpus.
+ */
+typedef struct corpus_opts {
+    size_t bytes;
+    int files;
+    size_t mean;
+    size_t max;
+    length_dist_t dist;
+    double density;
+    double casemix;
+    const char *keyword;
+} corpus_opts_t;
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+/**
+ * @brief Deterministic xorshift generator, the same seed gives the same corpus.
+ */
+static unsigned long long next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Returns a uniformly distributed number in [0, 1).
+ */
+static double next_unit(void) {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void usage(const char *myprog, const char *errormsg) {
+    fprintf(stderr, "Usage: %s [-s megabytes] [-n files] [-l mean] [-L max] [-d fixed|uniform|exp] "
+            "[-m density] [-c casemix] [-k keyword] [-S seed] output\nError: %s\n", myprog, errormsg);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Draws the length of the next line, without its newline.
+ */
+static size_t line_length(const corpus_opts_t *o) {
+    double len;
+    switch (o->dist) {
+    case DIST_UNIFORM:
+        len = 1 + next_random() % (2 * o->mean);
+        break;
+    case DIST_EXP:
+        len = 1 - log(1 - next_unit()) * o->mean;
+        break;
+    default:
+        len = o->mean;
+    }
+    return len > o->max ? o->max : (size_t)len;
+}
+
+/**
+ * @brief Writes `len` bytes of `word`, in random mixed case with probability `casemix`.
+ */
+static void put_word(char *dst, const char *word, size_t len, double casemix) {
+    size_t i = 0;
+    int mixed = next_unit() < casemix;
+    for (; i < len; i++) {
+        dst[i] = mixed && (next_random() & 1) ? (char)toupper((unsigned char)word[i]) : word[i];
+    }
+}
+
+/**
+ * @brief Fills `line` with filler words and, if `match`, one copy of the keyword.
+ *
+ * @return Length of the line including its newline.
+ */
+static size_t make_line(char *line, size_t len, int match, const corpus_opts_t *o, const char *alphabet, size_t nalpha) {
+    size_t klen = strlen(o->keyword), pos = 0, at = len;
+
+    if (match) {
+        if (len < klen) len = klen;
+        at = next_random() % (len - klen + 1);
+    }
+    while (pos < len) {
+        char word[16];
+        size_t wlen = 2 + next_random() % 9, i;
+
+        if (pos == at) {
+            put_word(line + pos, o->keyword, klen, o->casemix);
+            pos += klen;
+            continue;
+        }
+        if (pos + wlen > len) wlen = len - pos;
+        if (pos < at && pos + wlen > at) wlen = at - pos;
+        for (i = 0; i < wlen; i++) word[i] = alphabet[next_random() % nalpha];
+        put_word(line + pos, word, wlen, o->casemix);
+        pos += wlen;
+        if (pos < len && pos != at) line[pos++] = ' ';
+    }
+    line[pos++] = '\n';
+    return pos;
+}
+
+/**
+ * @brief Writes one corpus file of about `bytes` bytes.
+ *
+ * @return Number of lines that contain the keyword.
+ */
+static size_t write_file(const char *path, size_t bytes, const corpus_opts_t *o, size_t *lines) {
+    char alphabet[26];
+    size_t nalpha = 0, written = 0, matches = 0;
+    char *line = malloc(o->max + strlen(o->keyword) + 2);
+    FILE *out = fopen(path, "w");
+    int c = 'a';
+
+    if (line == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    if (out == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    for (; c <= 'z'; c++) {
+        if (c != tolower((unsigned char)o->keyword[0])) alphabet[nalpha++] = (char)c;
+    }
+
+    while (written < bytes) {
+        int match = next_unit() < o->density;
+        size_t len = make_line(line, line_length(o), match, o, alphabet, nalpha);
+        if (fwrite(line, len, 1, out) != 1) {
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        written += len;
+        matches += match;
+        (*lines)++;
+    }
+    if (fclose(out) == EOF) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    free(line);
+    return matches;
+}
+
+/**
+ * @brief Parses the options and writes the corpus.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return EXIT_SUCCESS.
+ */
+int main(int argc, char *argv[]) {
+    corpus_opts_t o = { .bytes = 64UL << 20, .files = 1, .mean = 100, .max = 0, .dist = DIST_UNIFORM,
+                        .density = 0.01, .casemix = 0.0, .keyword = DEFAULT_KEYWORD };
+    size_t lines = 0, matches = 0;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "s:n:l:L:d:m:c:k:S:")) != -1) {
+        switch (opt) {
+        case 's': o.bytes = strtoul(optarg, NULL, 10) << 20; break;
+        case 'n': o.files = atoi(optarg); break;
+        case 'l': o.mean = strtoul(optarg, NULL, 10); break;
+        case 'L': o.max = strtoul(optarg, NULL, 10); break;
+        case 'd':
+            if (strcmp(optarg, "fixed") == 0) o.dist = DIST_FIXED;
+            else if (strcmp(optarg, "uniform") == 0) o.dist = DIST_UNIFORM;
+            else if (strcmp(optarg, "exp") == 0) o.dist = DIST_EXP;
+            else usage(argv[0], "-d must be fixed, uniform or exp");
+            break;
+        case 'm': o.density = atof(optarg); break;
+        case 'c': o.casemix = atof(optarg); break;
+        case 'k': o.keyword = optarg; break;
+        case 'S': rng_state = strtoull(optarg, NULL, 0) | 1; break;
+        default: usage(argv[0], "invalid argument");
+        }
+    }
+    if (optind != argc - 1) usage(argv[0], "exactly one output is needed");
+    if (o.bytes == 0 || o.files < 1 || o.mean < 1) usage(argv[0], "size, file count and line length must be positive");
+    if (o.keyword[0] == '\0' || strchr(o.keyword, '\n') != NULL) usage(argv[0], "the keyword must be a non-empty line");
+    if (o.max == 0) o.max = 16 * o.mean;
+    if (o.max < o.mean) o.max = o.mean;
+
+    if (o.files == 1) {
+        matches = write_file(argv[optind], o.bytes, &o, &lines);
+    }
+    else {
+        if (mkdir(argv[optind], 0777) == -1 && errno != EEXIST) {
+            perror(argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        for (i = 0; i < o.files; i++) {
+            char *path = malloc(strlen(argv[optind]) + 32);
+            if (path == NULL) {
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+            sprintf(path, "%s/corpus-%03d.txt", argv[optind], i);
+            matches += write_file(path, o.bytes / o.files, &o, &lines);
+            free(path);
+        }
+    }
+    printf("%s: %d file(s), %zu lines, %zu matching \"%s\"\n", argv[optind], o.files, lines, matches, o.keyword);
+    exit(EXIT_SUCCESS);
+}
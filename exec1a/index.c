@@ -0,0 +1,856 @@
+/**
+ * @file index.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Building and querying the trigram index of a directory.
+ *
+ * The index file consists of a header followed by five sections, all of them arrays that
+ * are used in place after `mmap()`:
+ *
+ * - files: size, modification time, inode and tail hash of every indexed file, sorted by
+ *   path, so a file is found by binary search,
+ * - blocks: file, offset and length of every block; a block starts at a line start and
+ *   ends after a newline or at the end of its file,
+ * - trigrams: every trigram that occurs in a block, sorted, with its posting list,
+ * - postings: ascending block numbers per trigram,
+ * - names: the NUL-terminated paths relative to the indexed directory.
+ *
+ * Trigrams are folded to lower case and never contain a newline, so one index serves
+ * case-sensitive and `-i` queries alike; a lookup only has to return a superset of the
+ * blocks that match, every candidate block is still searched with the real matcher.
+ *
+ * The tail hash covers the last `TAIL_BYTES` indexed bytes of a file. If a file grew and
+ * still has the same tail, it was appended to and only the new data has to be indexed or,
+ * by a query, searched in full.
+ */
+
+#include "index.h"
+
+#include <dirent.h>
+
+#define INDEX_MAGIC "MYGREPIX"
+#define INDEX_VERSION 1
+/** Nominal block size, every block is extended to the end of its last line. */
+#define INDEX_BLOCK (32 * 1024)
+/** Indexed bytes at the end of a file whose hash has to match for an append. */
+#define TAIL_BYTES 4096
+/** Marks an old block that is not taken over into the new index. */
+#define DROPPED UINT32_MAX
+
+/**
+ * @struct index_header
+ * @brief Start of the index file; the section positions are byte offsets.
+ */
+typedef struct index_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t nfiles;
+    uint32_t nblocks;
+    uint32_t ntrigrams;
+    uint64_t files;
+    uint64_t blocks;
+    uint64_t trigrams;
+    uint64_t postings;
+    uint64_t names;
+    uint64_t size;
+} index_header_t;
+
+typedef struct index_file {
+    uint64_t size;
+    int64_t mtime;
+    int64_t mtimeNsec;
+    uint64_t inode;
+    uint64_t tail;
+    uint32_t name;
+    uint32_t reserved;
+} index_file_t;
+
+typedef struct index_block {
+    uint64_t offset;
+    uint32_t length;
+    uint32_t file;
+} index_block_t;
+
+typedef struct index_trigram {
+    uint32_t trigram;
+    uint32_t count;
+    uint64_t postings;
+} index_trigram_t;
+
+/**
+ * @struct index
+ * @brief An index file mapped into memory.
+ */
+typedef struct index {
+    char* map;
+    size_t size;
+    const index_header_t* header;
+    const index_file_t* files;
+    const index_block_t* blocks;
+    const index_trigram_t* trigrams;
+    const uint32_t* postings;
+    const char* names;
+} index_t;
+
+/**
+ * @struct filelist
+ * @brief Paths of the regular files below a directory, relative to it.
+ */
+typedef struct filelist {
+    char** paths;
+    size_t count;
+    size_t cap;
+} filelist_t;
+
+/**
+ * @struct posting
+ * @brief Posting list of one trigram while the index is built; free if `blocks` is NULL.
+ */
+typedef struct posting {
+    uint32_t trigram;
+    uint32_t count;
+    uint32_t cap;
+    uint32_t* blocks;
+} posting_t;
+
+/**
+ * @struct builder
+ * @brief The new index while it is built.
+ *
+ * @details `seen` is a bitmap over all 2^24 trigrams, `touched` lists the bits set for the
+ * current block, so the bitmap can be cleared again without touching all of it.
+ */
+typedef struct builder {
+    posting_t* postings;
+    size_t cap;
+    size_t used;
+    index_file_t* files;
+    index_block_t* blocks;
+    size_t nblocks;
+    size_t capblocks;
+    uint64_t* seen;
+    uint32_t* touched;
+    size_t captouched;
+} builder_t;
+
+
+/**
+ * @brief Allocates or grows memory or terminates the program.
+ */
+static void* xrealloc(void* old, size_t size){
+    void* p=realloc(old, size>0 ? size : 1);
+    if(p==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+
+/**
+ * @brief Returns `dir/name` in newly allocated memory; trailing slashes of `dir` are dropped.
+ */
+static char* joinPath(const char* dir, const char* name){
+    size_t len=strlen(dir);
+    char* path;
+
+    while(len>1 && dir[len-1]=='/') len--;
+    path=xrealloc(NULL, len+strlen(name)+2);
+    memcpy(path, dir, len);
+    path[len]='/';
+    strcpy(path+len+1, name);
+    return path;
+}
+
+
+/**
+ * @brief 64-bit FNV-1a hash of the last `TAIL_BYTES` of the first `size` bytes of `data`.
+ */
+static uint64_t tailHash(const char* data, uint64_t size){
+    uint64_t h=14695981039346656037ULL;
+    uint64_t i= size>TAIL_BYTES ? size-TAIL_BYTES : 0;
+
+    for(; i<size; i++) h=(h^(unsigned char)data[i])*1099511628211ULL;
+    return h;
+}
+
+
+static int comparePaths(const void* a, const void* b){
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+
+/**
+ * @brief Collects the regular files below `dir/rel`. Symbolic links to files are followed,
+ * links to directories are not, so the walk cannot loop.
+ *
+ * @return false if `dir/rel` could not be read.
+ */
+static bool listFiles(const char* dir, const char* rel, filelist_t* list){
+    char* path= rel[0]=='\0' ? joinPath(dir, ".") : joinPath(dir, rel);
+    struct dirent** entries;
+    int n=scandir(path, &entries, NULL, alphasort);
+    int i=0;
+
+    free(path);
+    if(n==-1) return false;
+    for(; i<n; i++){
+        const char* name=entries[i]->d_name;
+        char* child;
+        char* full;
+        struct stat st;
+
+        if(strcmp(name, ".")==0 || strcmp(name, "..")==0 ||
+           (rel[0]=='\0' && strncmp(name, INDEX_NAME, strlen(INDEX_NAME))==0)){
+            free(entries[i]);
+            continue;
+        }
+        child= rel[0]=='\0' ? strdup(name) : joinPath(rel, name);
+        if(child==NULL){
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        full=joinPath(dir, child);
+        if(lstat(full, &st)==0 && S_ISDIR(st.st_mode)){
+            listFiles(dir, child, list);
+            free(child);
+        }
+        else if(stat(full, &st)==0 && S_ISREG(st.st_mode)){
+            if(list->count==list->cap){
+                list->cap= list->cap>0 ? 2*list->cap : 64;
+                list->paths=xrealloc(list->paths, list->cap*sizeof(*list->paths));
+            }
+            list->paths[list->count++]=child;
+        }
+        else{
+            free(child);
+        }
+        free(full);
+        free(entries[i]);
+    }
+    free(entries);
+    return true;
+}
+
+
+/**
+ * @brief Lists the regular files below `dir` in `strcmp()` order.
+ */
+static bool listAllFiles(const char* dir, filelist_t* list){
+    if(!listFiles(dir, "", list)) return false;
+    qsort(list->paths, list->count, sizeof(*list->paths), comparePaths);
+    return true;
+}
+
+
+static void freeFiles(filelist_t* list){
+    for(; list->count>0; list->count--) free(list->paths[list->count-1]);
+    free(list->paths);
+}
+
+
+/**
+ * @brief Checks that all references inside a mapped index stay inside it, and unmaps it
+ * if not.
+ */
+static bool checkIndex(index_t* idx){
+    const index_header_t* h=idx->header;
+    uint64_t npostings=(h->names-h->postings)/sizeof(uint32_t);
+    uint32_t i=0;
+    bool ok= h->size==h->names || idx->map[h->size-1]=='\0';
+
+    for(; i<h->nfiles && ok; i++) ok= idx->files[i].name < h->size-h->names;
+    for(i=0; i<h->nblocks && ok; i++) ok= idx->blocks[i].file < h->nfiles;
+    for(i=0; i<h->ntrigrams && ok; i++){
+        ok= idx->trigrams[i].postings <= npostings && idx->trigrams[i].count <= npostings-idx->trigrams[i].postings;
+    }
+    if(!ok) munmap(idx->map, idx->size);
+    return ok;
+}
+
+
+/**
+ * @brief Maps and validates the index of `dir`.
+ *
+ * @return false if there is no index or it is damaged or of another version.
+ */
+static bool openIndex(const char* dir, index_t* idx){
+    char* path=joinPath(dir, INDEX_NAME);
+    int fd=open(path, O_RDONLY);
+    const index_header_t* h;
+    struct stat st;
+
+    free(path);
+    if(fd==-1) return false;
+    if(fstat(fd, &st)==-1 || (size_t)st.st_size<sizeof(index_header_t)){
+        close(fd);
+        return false;
+    }
+    idx->size=st.st_size;
+    idx->map=mmap(NULL, idx->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(idx->map==MAP_FAILED) return false;
+
+    h=idx->header=(const index_header_t*)idx->map;
+    if(memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic))!=0 || h->version!=INDEX_VERSION || h->size!=idx->size ||
+       h->files!=sizeof(*h) ||
+       h->blocks!=h->files+(uint64_t)h->nfiles*sizeof(index_file_t) ||
+       h->trigrams!=h->blocks+(uint64_t)h->nblocks*sizeof(index_block_t) ||
+       h->postings!=h->trigrams+(uint64_t)h->ntrigrams*sizeof(index_trigram_t) ||
+       h->names<h->postings || h->names>h->size || (h->names-h->postings)%sizeof(uint32_t)!=0 ||
+       (h->size>h->names && idx->map[h->size-1]!='\0')){
+        munmap(idx->map, idx->size);
+        return false;
+    }
+    idx->files=(const index_file_t*)(idx->map+h->files);
+    idx->blocks=(const index_block_t*)(idx->map+h->blocks);
+    idx->trigrams=(const index_trigram_t*)(idx->map+h->trigrams);
+    idx->postings=(const uint32_t*)(idx->map+h->postings);
+    idx->names=idx->map+h->names;
+    return checkIndex(idx);
+}
+
+
+/**
+ * @brief Finds a file by its relative path.
+ *
+ * @return Index of the file, or -1 if it is not indexed.
+ */
+static long findFile(const index_t* idx, const char* path){
+    long lo=0, hi=(long)idx->header->nfiles-1;
+
+    while(lo<=hi){
+        long mid=lo+(hi-lo)/2;
+        int cmp=strcmp(idx->names+idx->files[mid].name, path);
+        if(cmp==0) return mid;
+        if(cmp<0) lo=mid+1;
+        else hi=mid-1;
+    }
+    return -1;
+}
+
+
+/**
+ * @brief Finds the posting list of a trigram.
+ *
+ * @return The trigram entry, or NULL if the trigram occurs nowhere.
+ */
+static const index_trigram_t* findTrigram(const index_t* idx, uint32_t trigram){
+    long lo=0, hi=(long)idx->header->ntrigrams-1;
+
+    while(lo<=hi){
+        long mid=lo+(hi-lo)/2;
+        if(idx->trigrams[mid].trigram==trigram) return &idx->trigrams[mid];
+        if(idx->trigrams[mid].trigram<trigram) lo=mid+1;
+        else hi=mid-1;
+    }
+    return NULL;
+}
+
+
+/* ---------------------------------------------------------------- building */
+
+/**
+ * @brief Returns the posting list of a trigram, creating an empty one if needed.
+ */
+static posting_t* postingFor(builder_t* b, uint32_t trigram){
+    size_t slot;
+
+    if(2*(b->used+1) > b->cap){
+        posting_t* old=b->postings;
+        size_t oldcap=b->cap, i=0;
+        b->cap= b->cap>0 ? 2*b->cap : 1024;
+        b->postings=calloc(b->cap, sizeof(*b->postings));
+        if(b->postings==NULL){
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for(; i<oldcap; i++){
+            if(old[i].blocks==NULL) continue;
+            for(slot=(old[i].trigram*2654435761u)&(b->cap-1); b->postings[slot].blocks!=NULL; slot=(slot+1)&(b->cap-1));
+            b->postings[slot]=old[i];
+        }
+        free(old);
+    }
+    for(slot=(trigram*2654435761u)&(b->cap-1); b->postings[slot].blocks!=NULL; slot=(slot+1)&(b->cap-1)){
+        if(b->postings[slot].trigram==trigram) return &b->postings[slot];
+    }
+    b->postings[slot].trigram=trigram;
+    b->postings[slot].cap=4;
+    b->postings[slot].blocks=xrealloc(NULL, 4*sizeof(uint32_t));
+    b->used++;
+    return &b->postings[slot];
+}
+
+
+static void addPosting(posting_t* p, uint32_t block){
+    if(p->count==p->cap){
+        p->cap*=2;
+        p->blocks=xrealloc(p->blocks, p->cap*sizeof(*p->blocks));
+    }
+    p->blocks[p->count++]=block;
+}
+
+
+static uint32_t addBlock(builder_t* b, uint64_t offset, uint64_t length, uint32_t file){
+    if(b->nblocks==b->capblocks){
+        b->capblocks= b->capblocks>0 ? 2*b->capblocks : 256;
+        b->blocks=xrealloc(b->blocks, b->capblocks*sizeof(*b->blocks));
+    }
+    if(b->nblocks>=UINT32_MAX || length>UINT32_MAX){
+        fprintf(stderr, "index too large\n");
+        exit(EXIT_FAILURE);
+    }
+    b->blocks[b->nblocks]=(index_block_t){ .offset=offset, .length=(uint32_t)length, .file=file };
+    return (uint32_t)b->nblocks++;
+}
+
+
+/**
+ * @brief Adds block `block` to the posting lists of all trigrams in `data`.
+ */
+static void indexBlock(builder_t* b, const unsigned char* data, size_t len, uint32_t block){
+    uint32_t trigram=0;
+    size_t run=0, ntouched=0, i=0;
+
+    if(len>b->captouched){
+        b->captouched=len;
+        b->touched=xrealloc(b->touched, len*sizeof(*b->touched));
+    }
+    for(; i<len; i++){
+        unsigned char c=(unsigned char)tolower(data[i]);
+        if(c=='\n'){
+            run=0;
+            continue;
+        }
+        trigram=((trigram<<8)|c)&0xFFFFFF;
+        if(++run<3) continue;
+        if(b->seen[trigram>>6] & (1ULL<<(trigram&63))) continue;
+        b->seen[trigram>>6]|=1ULL<<(trigram&63);
+        b->touched[ntouched++]=trigram;
+    }
+    for(i=0; i<ntouched; i++){
+        addPosting(postingFor(b, b->touched[i]), block);
+        b->seen[b->touched[i]>>6]&=~(1ULL<<(b->touched[i]&63));
+    }
+}
+
+
+/**
+ * @brief Splits `data[from, size)` into line-aligned blocks and indexes them.
+ */
+static void indexFile(builder_t* b, const char* data, uint64_t from, uint64_t size, uint32_t file){
+    while(from<size){
+        uint64_t end= size-from<=INDEX_BLOCK ? size : from+INDEX_BLOCK;
+        if(end<size){
+            const char* eol=memchr(data+end-1, '\n', size-end+1);
+            end= eol==NULL ? size : (uint64_t)(eol-data)+1;
+        }
+        indexBlock(b, (const unsigned char*)data+from, end-from, addBlock(b, from, end-from, file));
+        from=end;
+    }
+}
+
+
+static int compareTrigrams(const void* a, const void* b){
+    uint32_t x=((const posting_t*)a)->trigram, y=((const posting_t*)b)->trigram;
+    return (x>y)-(x<y);
+}
+
+
+/**
+ * @brief Writes the finished index to `path`.
+ */
+static bool writeIndex(builder_t* b, const filelist_t* list, const char* path){
+    index_header_t h = { .version=INDEX_VERSION, .nfiles=list->count, .nblocks=b->nblocks };
+    FILE* out=fopen(path, "w");
+    uint64_t npostings=0, namelen=0;
+    size_t i=0, n=0;
+    bool ok;
+
+    if(out==NULL) return false;
+    /* pack the used hash slots and sort them by trigram */
+    for(; i<b->cap; i++){
+        if(b->postings[i].blocks==NULL) continue;
+        b->postings[n++]=b->postings[i];
+    }
+    qsort(b->postings, n, sizeof(*b->postings), compareTrigrams);
+    for(i=0; i<n; i++) npostings+=b->postings[i].count;
+    for(i=0; i<list->count; i++){
+        b->files[i].name=(uint32_t)namelen;
+        namelen+=strlen(list->paths[i])+1;
+    }
+
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.ntrigrams=n;
+    h.files=sizeof(h);
+    h.blocks=h.files+(uint64_t)h.nfiles*sizeof(index_file_t);
+    h.trigrams=h.blocks+(uint64_t)h.nblocks*sizeof(index_block_t);
+    h.postings=h.trigrams+(uint64_t)h.ntrigrams*sizeof(index_trigram_t);
+    h.names=h.postings+npostings*sizeof(uint32_t);
+    h.size=h.names+namelen;
+
+    ok= fwrite(&h, sizeof(h), 1, out)==1;
+    ok= ok && fwrite(b->files, sizeof(*b->files), list->count, out)==list->count;
+    ok= ok && fwrite(b->blocks, sizeof(*b->blocks), b->nblocks, out)==b->nblocks;
+    for(npostings=0, i=0; i<n && ok; i++){
+        index_trigram_t t = { .trigram=b->postings[i].trigram, .count=b->postings[i].count, .postings=npostings };
+        ok= fwrite(&t, sizeof(t), 1, out)==1;
+        npostings+=t.count;
+    }
+    for(i=0; i<n && ok; i++) ok= fwrite(b->postings[i].blocks, sizeof(uint32_t), b->postings[i].count, out)==b->postings[i].count;
+    for(i=0; i<list->count && ok; i++) ok= fputs(list->paths[i], out)!=EOF && fputc('\0', out)!=EOF;
+    for(i=0; i<n; i++) free(b->postings[i].blocks);
+    b->used=0;
+    return fclose(out)!=EOF && ok;
+}
+
+
+/**
+ * @brief Decides how much of a file the old index still covers.
+ *
+ * @param full Path of the file.
+ * @param st Its current status.
+ * @param old The file in the old index, or NULL.
+ * @param lastBlock Offset of its last block in the old index.
+ * @return Number of bytes from the start whose old blocks can be taken over.
+ */
+static uint64_t reusable(const char* full, const struct stat* st, const index_file_t* old, uint64_t lastBlock){
+    uint64_t size=st->st_size;
+    uint64_t keep=0;
+    char* data;
+    int fd;
+
+    if(old==NULL || old->inode!=(uint64_t)st->st_ino || size<old->size) return 0;
+    if(size==old->size && old->mtime==(int64_t)st->st_mtim.tv_sec && old->mtimeNsec==(int64_t)st->st_mtim.tv_nsec) return size;
+    if(size==old->size || (fd=open(full, O_RDONLY))==-1) return 0;
+    data=mmap(NULL, old->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data==MAP_FAILED) return 0;
+    if(tailHash(data, old->size)==old->tail){
+        /* an unterminated last line continues in the appended data */
+        keep= data[old->size-1]=='\n' ? old->size : lastBlock;
+    }
+    munmap(data, old->size);
+    return keep;
+}
+
+
+/**
+ * @brief Takes over the still valid blocks and postings of the old index, then indexes
+ * everything new and writes the result next to the old index before replacing it.
+ *
+ * @details New block numbers are handed out to the kept blocks in their old order first,
+ * so the remapped old posting lists stay sorted and the new blocks can simply be appended.
+ */
+bool buildIndex(const char* dir){
+    builder_t b = { .postings=NULL };
+    filelist_t list = { .paths=NULL };
+    index_t old;
+    bool haveOld=openIndex(dir, &old);
+    uint64_t* keep;
+    uint64_t* lastBlock=NULL;
+    long* newFile=NULL;
+    uint32_t* remap=NULL;
+    char* path;
+    char* tmp;
+    size_t i=0;
+    bool ok;
+
+    if(!listAllFiles(dir, &list)){
+        if(haveOld) munmap(old.map, old.size);
+        return false;
+    }
+    keep=calloc(list.count+1, sizeof(*keep));
+    b.files=calloc(list.count+1, sizeof(*b.files));
+    b.seen=calloc(1<<18, sizeof(*b.seen));
+    if(keep==NULL || b.files==NULL || b.seen==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if(haveOld){
+        lastBlock=calloc(old.header->nfiles+1, sizeof(*lastBlock));
+        newFile=xrealloc(NULL, (old.header->nfiles+1)*sizeof(*newFile));
+        remap=xrealloc(NULL, (old.header->nblocks+1)*sizeof(*remap));
+        if(lastBlock==NULL){
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        for(i=0; i<old.header->nfiles; i++) newFile[i]=-1;
+        for(i=0; i<old.header->nblocks; i++){
+            if(old.blocks[i].offset>lastBlock[old.blocks[i].file]) lastBlock[old.blocks[i].file]=old.blocks[i].offset;
+        }
+    }
+
+    /* how much of every file the old index covers */
+    for(i=0; i<list.count; i++){
+        char* full=joinPath(dir, list.paths[i]);
+        long of= haveOld ? findFile(&old, list.paths[i]) : -1;
+        struct stat st;
+
+        if(stat(full, &st)==0 && of>=0){
+            keep[i]=reusable(full, &st, &old.files[of], lastBlock[of]);
+            if(keep[i]>0){
+                newFile[of]=i;
+                b.files[i]=old.files[of];
+            }
+        }
+        free(full);
+    }
+
+    /* kept blocks in their old order, then their postings */
+    if(haveOld){
+        for(i=0; i<old.header->nblocks; i++){
+            const index_block_t* ob=&old.blocks[i];
+            long f=newFile[ob->file];
+            remap[i]= f>=0 && ob->offset+ob->length<=keep[f] ? addBlock(&b, ob->offset, ob->length, f) : DROPPED;
+        }
+        for(i=0; i<old.header->ntrigrams; i++){
+            const index_trigram_t* t=&old.trigrams[i];
+            posting_t* p=NULL;
+            uint32_t j=0;
+            for(; j<t->count; j++){
+                uint32_t id=old.postings[t->postings+j];
+                uint32_t block= id<old.header->nblocks ? remap[id] : DROPPED;
+                if(block==DROPPED) continue;
+                if(p==NULL) p=postingFor(&b, t->trigram);
+                addPosting(p, block);
+            }
+        }
+    }
+
+    /* everything the old index does not cover */
+    for(i=0; i<list.count; i++){
+        char* full=joinPath(dir, list.paths[i]);
+        int fd=open(full, O_RDONLY);
+        struct stat st;
+        char* data;
+
+        free(full);
+        if(fd==-1) continue;
+        if(fstat(fd, &st)==-1 || (uint64_t)st.st_size<keep[i] || (uint64_t)st.st_size==keep[i]){
+            close(fd);
+            continue;
+        }
+        data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(data==MAP_FAILED) continue;
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        indexFile(&b, data, keep[i], st.st_size, i);
+        b.files[i].size=st.st_size;
+        b.files[i].mtime=st.st_mtim.tv_sec;
+        b.files[i].mtimeNsec=st.st_mtim.tv_nsec;
+        b.files[i].inode=st.st_ino;
+        b.files[i].tail=tailHash(data, st.st_size);
+        munmap(data, st.st_size);
+    }
+    if(haveOld) munmap(old.map, old.size);
+
+    path=joinPath(dir, INDEX_NAME);
+    tmp=xrealloc(NULL, strlen(path)+5);
+    sprintf(tmp, "%s.tmp", path);
+    ok=writeIndex(&b, &list, tmp);
+    if(ok) ok= rename(tmp, path)==0;
+    else unlink(tmp);
+
+    free(tmp);
+    free(path);
+    free(b.postings);
+    free(b.blocks);
+    free(b.files);
+    free(b.seen);
+    free(b.touched);
+    free(keep);
+    free(lastBlock);
+    free(newFile);
+    free(remap);
+    freeFiles(&list);
+    return ok;
+}
+
+
+/* ---------------------------------------------------------------- querying */
+
+/**
+ * @brief Returns whether `block` occurs in the ascending list `list`.
+ */
+static bool contains(const uint32_t* list, uint32_t count, uint32_t block){
+    uint32_t lo=0, hi=count;
+    while(lo<hi){
+        uint32_t mid=lo+(hi-lo)/2;
+        if(list[mid]==block) return true;
+        if(list[mid]<block) lo=mid+1;
+        else hi=mid;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Marks the blocks that contain all trigrams of `literal`.
+ *
+ * @return false if the literal has no trigram, every block is a candidate then.
+ */
+static bool markLiteral(const index_t* idx, const char* literal, bool* candidate){
+    const index_trigram_t* found[256];
+    const index_trigram_t* shortest=NULL;
+    size_t len=strlen(literal), run=0, n=0, i=0, j;
+    uint32_t trigram=0;
+
+    for(; i<len; i++){
+        unsigned char c=(unsigned char)tolower((unsigned char)literal[i]);
+        const index_trigram_t* t;
+        if(c=='\n'){
+            run=0;
+            continue;
+        }
+        trigram=((trigram<<8)|c)&0xFFFFFF;
+        if(++run<3) continue;
+        if((t=findTrigram(idx, trigram))==NULL) return true;
+        for(j=0; j<n && found[j]!=t; j++);
+        if(j==n && n<sizeof(found)/sizeof(found[0])) found[n++]=t;
+        if(shortest==NULL || t->count<shortest->count) shortest=t;
+    }
+    if(shortest==NULL) return false;
+
+    for(i=0; i<shortest->count; i++){
+        uint32_t block=idx->postings[shortest->postings+i];
+        if(block>=idx->header->nblocks) continue;
+        for(j=0; j<n; j++){
+            if(found[j]!=shortest && !contains(idx->postings+found[j]->postings, found[j]->count, block)) break;
+        }
+        if(j==n) candidate[block]=true;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Decides for every block whether it can contain a match.
+ */
+static void markCandidates(const index_t* idx, const matcher_t* matcher, bool* candidate){
+    char* const* literals;
+    int count=matcher_literals(matcher, &literals);
+    int i=0;
+    bool all= count==0;
+
+    for(; i<count && !all; i++) all= !markLiteral(idx, literals[i], candidate);
+    if(all) memset(candidate, true, idx->header->nblocks);
+}
+
+
+/**
+ * @brief Searches one file using the candidate blocks of the index.
+ *
+ * @details The index covers the file if it has the same inode and is unchanged or only
+ * appended to. Runs of adjacent candidate blocks are searched as one buffer, appended
+ * data (from the start of the last indexed line on, which may have been continued) in
+ * full. A file the index does not cover is searched completely.
+ */
+static void searchIndexed(const index_t* idx, long file, const uint32_t* blocks, size_t nblocks,
+                          const bool* candidate, const char* full, search_t* s){
+    const index_file_t* f= file>=0 ? &idx->files[file] : NULL;
+    writer_t writer;
+    struct stat st;
+    uint64_t size, tailStart;
+    size_t i=0;
+    char* data;
+    int fd;
+    bool done=false;
+
+    if(f==NULL || (fd=open(full, O_RDONLY))==-1){
+        if(!searchFile(full, s->output, s->opts)) perror(full);
+        return;
+    }
+    if(fstat(fd, &st)==-1 || !S_ISREG(st.st_mode) || (uint64_t)st.st_ino!=f->inode || (uint64_t)st.st_size<f->size
+       || f->size==0 || (data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))==MAP_FAILED){
+        close(fd);
+        if(!searchFile(full, s->output, s->opts)) perror(full);
+        return;
+    }
+    close(fd);
+    size=st.st_size;
+    if(size==f->size ? f->mtime!=(int64_t)st.st_mtim.tv_sec || f->mtimeNsec!=(int64_t)st.st_mtim.tv_nsec
+                     : tailHash(data, f->size)!=f->tail){
+        munmap(data, size);
+        if(!searchFile(full, s->output, s->opts)) perror(full);
+        return;
+    }
+
+    if(writerInit(&writer, s->output, s->opts->flush)) s->writer=&writer;
+    tailStart=f->size;
+    if(size>f->size && data[f->size-1]!='\n'){
+        while(tailStart>0 && data[tailStart-1]!='\n') tailStart--;
+    }
+    while(i<nblocks && !done){
+        uint64_t start, end;
+        if(!candidate[blocks[i]]){
+            i++;
+            continue;
+        }
+        start=idx->blocks[blocks[i]].offset;
+        end=start+idx->blocks[blocks[i]].length;
+        for(i++; i<nblocks && candidate[blocks[i]] && idx->blocks[blocks[i]].offset==end; i++){
+            end+=idx->blocks[blocks[i]].length;
+        }
+        if(end>tailStart) end=tailStart;
+        if(end>start) done=searchBuffer(data+start, end-start, s);
+    }
+    if(!done && size>tailStart) searchBuffer(data+tailStart, size-tailStart, s);
+    if(s->writer!=NULL) writerFlush(&writer);
+    s->writer=NULL;
+    munmap(data, size);
+    searchReport(s, full);
+}
+
+
+bool searchIndex(const char* dir, FILE* output, const options_t* opts){
+    filelist_t list = { .paths=NULL };
+    options_t local=*opts;
+    index_t idx;
+    bool* candidate;
+    uint32_t* first;
+    uint32_t* order;
+    uint32_t i=0;
+    size_t j=0;
+
+    if(!openIndex(dir, &idx)) return false;
+    if(!listAllFiles(dir, &list)){
+        munmap(idx.map, idx.size);
+        return false;
+    }
+    candidate=calloc(idx.header->nblocks+1, sizeof(*candidate));
+    first=calloc(idx.header->nfiles+2, sizeof(*first));
+    order=calloc(idx.header->nblocks+1, sizeof(*order));
+    if(candidate==NULL || first==NULL || order==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    markCandidates(&idx, &opts->pattern->matcher, candidate);
+
+    /* blocks grouped by file, in ascending order within every file */
+    for(; i<idx.header->nblocks; i++) first[idx.blocks[i].file+2]++;
+    for(i=2; i<idx.header->nfiles+2; i++) first[i]+=first[i-1];
+    for(i=0; i<idx.header->nblocks; i++) order[first[idx.blocks[i].file+1]++]=i;
+
+    local.withNames= list.count>1;
+    for(; j<list.count; j++){
+        search_t search = { .opts=&local, .output=output };
+        long file=findFile(&idx, list.paths[j]);
+        char* full=joinPath(dir, list.paths[j]);
+        const uint32_t* blocks= file>=0 ? order+first[file] : NULL;
+        size_t nblocks= file>=0 ? first[file+1]-first[file] : 0;
+
+        searchIndexed(&idx, file, blocks, nblocks, candidate, full, &search);
+        free(full);
+    }
+
+    free(candidate);
+    free(first);
+    free(order);
+    freeFiles(&list);
+    munmap(idx.map, idx.size);
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef INDEX_H
+#define INDEX_H
+/**
+ * @file index.h
+ * @brief Persistent trigram index over a directory for repeated `mygrep` queries.
+ *
+ * `--build-index DIR` splits every regular file below `DIR` into line-aligned blocks and
+ * writes, for every trigram, the list of blocks containing it to `DIR/.mygrep-index`. The
+ * file is laid out so it can be memory-mapped and used without parsing.
+ *
+ * `--index DIR` looks up the trigrams of the keywords (or of the literals every regular
+ * expression match must contain) and searches only the blocks that contain all trigrams of
+ * at least one of them, plus everything the index does not cover: new files, data appended
+ * since the index was built, and files that changed otherwise. The output is the same as
+ * searching all files below `DIR` in sorted path order.
+ *
+ * Rebuilding an existing index is incremental: blocks of unchanged files and of files that
+ * were only appended to are taken over from the old index, only new data is read.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "mygrep.h"
+
+/** Name of the index file inside the indexed directory. */
+#define INDEX_NAME ".mygrep-index"
+
+/**
+ * @brief Builds or updates the index of all regular files below `dir`.
+ *
+ * @param dir Directory to index.
+ * @return false if the directory could not be read or the index not written.
+ */
+bool buildIndex(const char* dir);
+
+/**
+ * @brief Searches all regular files below `dir` with the help of its index.
+ *
+ * @details Files are searched in sorted path order and named `dir/path`; with more than
+ * one file `-c` prefixes the counts with the names.
+ *
+ * @param dir Indexed directory.
+ * @param output Output file pointer.
+ * @param opts Search settings.
+ * @return false if the index could not be opened.
+ */
+bool searchIndex(const char* dir, FILE* output, const options_t* opts);
+
+#endif // INDEX_H
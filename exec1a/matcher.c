@@ -0,0 +1,71 @@
+/**
+ * @file matcher.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Selects and dispatches to the search engine for a set of keywords.
+ */
+
+#include "matcher.h"
+
+#include <string.h>
+
+/**
+ * @brief Uses the DFA for regular expressions, the substring kernel for exactly one
+ * keyword and the automaton otherwise.
+ */
+const char *matcher_compile(matcher_t *m, char *const keywords[], int count, bool nocase, bool regex) {
+    int i = 0;
+
+    m->keywords = keywords;
+    m->count = count;
+    m->multiline = false;
+    m->unbounded = false;
+    m->maxlen = 0;
+    if (regex) {
+        m->kind = MATCH_REGEX;
+        m->unbounded = true;
+        return regexp_compile(&m->regex, keywords, count, nocase);
+    }
+    for (; i < count; i++) {
+        if (strchr(keywords[i], '\n') != NULL) m->multiline = true;
+        if (strlen(keywords[i]) > m->maxlen) m->maxlen = strlen(keywords[i]);
+    }
+
+    if (count == 1) {
+        m->kind = MATCH_LITERAL;
+        return search_compile(&m->literal, keywords[0], strlen(keywords[0]), nocase);
+    }
+    m->kind = MATCH_MULTI;
+    return ac_compile(&m->multi, keywords, count, nocase);
+}
+
+/**
+ * @brief Dispatches to the engine chosen by `matcher_compile()`.
+ */
+const char *matcher_find(const matcher_t *m, const char *hay, size_t len) {
+    if (m->kind == MATCH_LITERAL) return search_find(&m->literal, hay, len);
+    if (m->kind == MATCH_REGEX) return regexp_find(&m->regex, hay, len);
+    return ac_find(&m->multi, hay, len);
+}
+
+/**
+ * @brief Plain keywords are their own literals, regular expressions report their prefilter.
+ */
+int matcher_literals(const matcher_t *m, char *const **literals) {
+    if (m->kind == MATCH_REGEX) {
+        *literals = m->regex.literals;
+        return m->regex.nlits;
+    }
+    *literals = m->keywords;
+    return m->count;
+}
+
+/**
+ * @brief Frees the engine chosen by `matcher_compile()`.
+ */
+void matcher_free(matcher_t *m) {
+    if (m->kind == MATCH_LITERAL) search_free(&m->literal);
+    else if (m->kind == MATCH_REGEX) regexp_free(&m->regex);
+    else ac_free(&m->multi);
+}
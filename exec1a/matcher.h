@@ -0,0 +1,92 @@
+#ifndef MATCHER_H
+#define MATCHER_H
+/**
+ * @file matcher.h
+ * @brief The compiled set of keywords `mygrep` searches for.
+ *
+ * A single keyword uses the vectorized substring kernel from `search.h`, several keywords
+ * are compiled into one Aho-Corasick automaton and `-E` patterns into a DFA (`regexp.h`).
+ * All of them are searched with `matcher_find()`, so the input paths do not care how many
+ * keywords were given or whether they are regular expressions.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "search.h"
+#include "ahocorasick.h"
+#include "regexp.h"
+
+/**
+ * @enum MATCHER_KIND
+ * @brief Search engine behind a matcher.
+ */
+typedef enum MATCHER_KIND {
+    MATCH_LITERAL = 0,
+    MATCH_MULTI = 1,
+    MATCH_REGEX = 2
+} matcher_kind_t;
+
+/**
+ * @struct matcher
+ * @brief Compiled keywords.
+ *
+ * @details `multiline` is set if a keyword contains a newline. Such a keyword could match
+ * across lines when a whole buffer is searched, so those matchers may only be used on
+ * single lines. `maxlen` is the length of the longest keyword, a match can never span
+ * more bytes than that. A regular expression match can be arbitrarily long within its
+ * line; `maxlen` is 0 and `unbounded` is set then, so lines have to be searched whole.
+ * `keywords` and `count` refer to the caller's keyword array.
+ */
+typedef struct matcher {
+    matcher_kind_t kind;
+    searcher_t literal;
+    ac_t multi;
+    regexp_t regex;
+    char *const *keywords;
+    int count;
+    bool multiline;
+    bool unbounded;
+    size_t maxlen;
+} matcher_t;
+
+/**
+ * @brief Compiles the keywords.
+ *
+ * @param m The matcher to initialise.
+ * @param keywords The keywords, NUL-terminated; the array has to outlive the matcher.
+ * @param count Number of keywords; with 0 keywords nothing matches.
+ * @param nocase If true, ASCII letters match regardless of their case.
+ * @param regex If true, the keywords are extended regular expressions.
+ * @return NULL on success, otherwise a message describing an invalid regular expression,
+ * a keyword set too large to compile or "out of memory". Nothing has to be freed then.
+ */
+const char *matcher_compile(matcher_t *m, char *const keywords[], int count, bool nocase, bool regex);
+
+/**
+ * @brief Finds the first keyword occurrence in `hay`.
+ *
+ * @param m A compiled matcher.
+ * @param hay Start of the bytes to scan.
+ * @param len Number of bytes to scan.
+ * @return Pointer to the first byte of the match, or NULL if there is none. For regular
+ * expressions `hay` has to start at a line start and the result is some byte of the first
+ * matching line, at or after the start of the match.
+ */
+const char *matcher_find(const matcher_t *m, const char *hay, size_t len);
+
+/**
+ * @brief Lists literals of which every match contains at least one, e.g. for an index lookup.
+ *
+ * @param m A compiled matcher.
+ * @param literals Receives the literals, valid as long as the matcher and its keywords.
+ * @return Number of literals, 0 if nothing is known about the matches.
+ */
+int matcher_literals(const matcher_t *m, char *const **literals);
+
+/**
+ * @brief Releases the memory held by a matcher.
+ */
+void matcher_free(matcher_t *m);
+
+#endif // MATCHER_H
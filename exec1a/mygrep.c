@@ -7,10 +7,34 @@
  *
  * This program reads input from files or stdin and searches each line for a specific keyword.
  * If a line contains the keyword, it is printed to stdout or to an output file if specified.
- * When the `-i` option is included, the search becomes case-insensitive.
+ * When the `-i` option is included, the search becomes case-insensitive. Several keywords
+ * can be given with repeated `-e` options or one per line in a file with `-f`; a line
+ * matches if it contains any of them. With `-E` the keywords are extended regular
+ * expressions, matched by a DFA in linear time.
+ * Regular input files are memory-mapped and searched without copying, stdin and pipes
+ * are read in large blocks. With `-j N` several input files are searched concurrently, a
+ * single large file is split into line-aligned chunks that are searched concurrently.
+ * `-c` prints the number of matching lines, `-l` the names of matching inputs and `-m N`
+ * stops after N matching lines; all three stop reading an input once the result is known.
+ * `--build-index DIR` writes a trigram index of all files below `DIR`, `--index DIR` then
+ * answers queries over these files from the index, searching only blocks that can match.
+ * `-r` searches all regular, non-binary files below the given directories (or the current
+ * one), read and searched by one thread per CPU unless `-j` says otherwise.
+ * A long list of input files searched by one thread is opened and read ahead through
+ * io_uring if the kernel provides it.
+ * Matching lines of mapped files are written with `writev()` straight from the mapping in
+ * large batches; on a terminal or with `--line-buffered` every line is written at once.
  */
 
 #include "mygrep.h"  
+#include "parallel.h"
+#include "stream.h"
+#include "index.h"
+#include "walk.h"
+#include "uring.h"
+
+/** Codes of the long options without a short form. */
+enum { OPT_BUILD_INDEX=256, OPT_INDEX, OPT_LINE_BUFFERED };
 
 
 /**
@@ -26,19 +50,54 @@
  */
 int main(int argc,char *argv[]){
     char *myprog=argv[0];
-    FILE* input=stdin;
     FILE* output=NULL;
 
     int opt;
     bool caseInsensitive=false;          
-    char* keyword;
+    bool regex=false;
+    bool recursive=false;
+    bool lineBuffered=false;
+    int threads=0;
+    long number;
+    char** keywords=NULL;
+    int nkeywords=0;
+    bool explicitKeywords=false;
+    pattern_t pattern;
+    const char* error;
+    int failed;
+    options_t opts = { .pattern=&pattern, .mode=OUTPUT_LINES, .maxCount=-1 };
+    const char* buildDir=NULL;
+    const char* indexDir=NULL;
+    static const struct option longopts[] = {
+        { "build-index", required_argument, NULL, OPT_BUILD_INDEX },
+        { "index", required_argument, NULL, OPT_INDEX },
+        { "line-buffered", no_argument, NULL, OPT_LINE_BUFFERED },
+        { NULL, 0, NULL, 0 }
+    };
 
-    while((opt=getopt(argc, argv, "io:"))!=-1){
+    while((opt=getopt_long(argc, argv, "cEe:f:ij:lm:o:r", longopts, NULL))!=-1){
         switch(opt){
+            case OPT_BUILD_INDEX:
+                if(buildDir != NULL || indexDir != NULL) usage(myprog, "only one of --build-index and --index can be declared");
+                    buildDir = optarg;
+                    break;
+            case OPT_LINE_BUFFERED:
+                    lineBuffered=true;
+                    break;
+            case OPT_INDEX:
+                if(buildDir != NULL || indexDir != NULL) usage(myprog, "only one of --build-index and --index can be declared");
+                    indexDir = optarg;
+                    break;
             case 'i':
                     if(caseInsensitive) usage(myprog, "only one -i can be declared");
                 	caseInsensitive=true;
                     break;
+            case 'E':
+                    regex=true;
+                    break;
+            case 'r':
+                    recursive=true;
+                    break;
             case 'o':
                 if(output != NULL) usage(myprog, "only one outputfile can be declared");
                     output = fopen(optarg, "w");
@@ -46,29 +105,108 @@ int main(int argc,char *argv[]){
                         usage(myprog, "not able to open the outputfile.");
                     }
                     break;
+            case 'j':
+                if(threads != 0) usage(myprog, "only one -j can be declared");
+                    errno=0;
+                    number = strtol(optarg, NULL, 0);
+                    if(errno==ERANGE || number < 1 || number > INT_MAX) usage(myprog, "-j needs a positive number of threads");
+                    threads = number;
+                    break;
+            case 'c':
+            case 'l':
+                if(opts.mode != OUTPUT_LINES) usage(myprog, "only one of -c and -l can be declared");
+                    opts.mode = opt=='c' ? OUTPUT_COUNT : OUTPUT_FILES;
+                    break;
+            case 'm':
+                if(opts.maxCount != -1) usage(myprog, "only one -m can be declared");
+                    errno=0;
+                    opts.maxCount = strtol(optarg, NULL, 0);
+                    if(errno==ERANGE || opts.maxCount < 0) usage(myprog, "-m needs a non-negative number of matches");
+                    break;
+            case 'e':
+                    addKeyword(&keywords, &nkeywords, optarg);
+                    explicitKeywords=true;
+                    break;
+            case 'f':
+                    if(!readKeywords(optarg, &keywords, &nkeywords)) {
+                        usage(myprog, "not able to open the patternfile.");
+                    }
+                    explicitKeywords=true;
+                    break;
             default: /* ? */
                 usage(myprog,"invalid argument");
         }
     }
-    if(optind==argc){
-        usage(myprog,"no keyword provided");
+    if(recursive && (buildDir != NULL || indexDir != NULL)) usage(myprog, "-r cannot be combined with an index");
+    if(buildDir != NULL){
+        if(explicitKeywords || optind != argc) usage(myprog, "--build-index takes no keyword and no files");
+        if(!buildIndex(buildDir)){
+            perror(buildDir);
+            exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+    }
+    if(!explicitKeywords){
+        if(optind==argc){
+            usage(myprog,"no keyword provided");
+        }
+        addKeyword(&keywords, &nkeywords, argv[optind]);
+        optind++;
     }
     output = output ==NULL ?  stdout : output;
-    keyword=argv[optind];
-    optind++;
+    opts.flush = lineBuffered || isatty(fileno(output)) ? FLUSH_LINES : FLUSH_BULK;
+    outputSetup(output, opts.flush);
+    errno=0;
+    error=pattern_compile(&pattern, (const char* const*)keywords, nkeywords,
+                          (caseInsensitive ? PATTERN_NOCASE : 0) | (regex ? PATTERN_REGEX : 0));
+    if(error!=NULL && errno==ENOMEM){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    if(error!=NULL) usage(myprog, error);
+    for(; nkeywords>0; nkeywords--) free(keywords[nkeywords-1]);
+    free(keywords);
+    if(threads==0 && recursive){
+        long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+        threads= cpus>0 && cpus<=INT_MAX ? cpus : 1;
+    }
+    opts.threads = threads>0 ? threads : 1;
+    opts.withNames = argc-optind > 1 || recursive;
+    opts.skipBinary = recursive;
 
-    if(argc==optind) readLine(input, output, caseInsensitive, keyword);
+    if(indexDir != NULL){
+        if(argc != optind) usage(myprog, "--index takes no files");
+        if(!searchIndex(indexDir, output, &opts)) usage(myprog, "unable to open the index, build it with --build-index");
+    }
+    else if(recursive){
+        if(!searchTree(&argv[optind], argc-optind, output, &opts)){
+            fclose(output);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if(argc==optind){
+        search_t search = { .opts=&opts, .output=output };
+        searchStream(STDIN_FILENO, &search);
+        searchReport(&search, "(standard input)");
+    }
+    else if(opts.threads > 1 && argc-optind > 1){
+        if(searchFilesParallel(&argv[optind], argc-optind, output, &opts) != -1) {
+            usage(myprog,"unable to open one of the inputfiles.");
+        }
+    }
+    else if(argc-optind >= URING_MIN_FILES
+            && (failed=searchFilesUring(&argv[optind], argc-optind, output, &opts)) != URING_UNAVAILABLE){
+        if(failed != -1) usage(myprog,"unable to open one of the inputfiles.");
+    }
     else{
         for(; optind<argc; optind++){
-            input=fopen(argv[optind], "r");
-            if(input == NULL) {
+            if(!searchFile(argv[optind], output, &opts)) {
                 usage(myprog,"unable to open one of the inputfiles.");
             }
-            readLine(input, output, caseInsensitive, keyword);
-            fclose(input);
         }
     }
     fclose(output);
+    pattern_free(&pattern);
 
     exit(EXIT_SUCCESS);
 }
@@ -82,62 +220,249 @@ int main(int argc,char *argv[]){
  * @param myprog The name of the program (argv[0]).
  * @param errormsg The specific error message to be displayed.
  */
-void usage(char* myprog, char* errormsg) {
-    fprintf(stderr, "Usage: %s -i -o [outputfile] keyword [file ...]\nError: %s\n", myprog, errormsg);
+void usage(char* myprog, const char* errormsg) {
+    fprintf(stderr, "Usage: %s [-i] [-E] [-r] [-c | -l] [-m max] [-j threads] [--line-buffered] [-o outputfile] {keyword | -e keyword ... | -f patternfile} [file ... | --index dir]\n       %s --build-index dir\nError: %s\n", myprog, myprog, errormsg);
     exit(EXIT_FAILURE);
 }
 
 
 /**
- * @brief Reads lines from input and searches for the keyword.
+ * @brief Appends a copy of `keyword` to a growing keyword array.
+ *
+ * @param keywords Pointer to the array, reallocated as needed.
+ * @param count Pointer to the number of keywords in the array.
+ * @param keyword The keyword to copy.
+ */
+void addKeyword(char*** keywords, int* count, const char* keyword){
+    char** grown=realloc(*keywords, (*count+1)*sizeof(**keywords));
+    if(grown==NULL || (grown[*count]=strdup(keyword))==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    *keywords=grown;
+    (*count)++;
+}
+
+
+/**
+ * @brief Reads one keyword per line from a pattern file.
  *
- * This function reads each line from the given input file and checks if it contains
- * the specified keyword. If the line matches, it is written to the output file.
+ * The trailing newline of every line is removed; an empty line is an empty keyword,
+ * which matches every line.
  *
- * @param input Input file pointer (stdin or an opened file).
- * @param output Output file pointer (stdout or an opened file).
- * @param caseInsensitive Boolean flag for case-insensitive search.
- * @param keyword The keyword to search for in each line.
+ * @param path Path of the pattern file.
+ * @param keywords Pointer to the keyword array, reallocated as needed.
+ * @param count Pointer to the number of keywords in the array.
+ * @return false if the file could not be opened.
  */
-void readLine(FILE * input, FILE* output, bool caseInsensitive,char* keyword){
-    char *line =NULL;
+bool readKeywords(const char* path, char*** keywords, int* count){
+    FILE* patterns=fopen(path, "r");
+    char* line=NULL;
     size_t len=0;
     ssize_t nread;
 
-    while((nread=getline(&line, &len, input))!=-1){
-
-        if(strstr(line, keyword)!=NULL || (caseInsensitive &&  strstr(toUpperCase(line),toUpperCase(keyword))!=NULL ))
-        {
-            fwrite(line, nread, 1, output);
-        }
+    if(patterns==NULL) return false;
+    while((nread=getline(&line, &len, patterns))!=-1){
+        if(nread>0 && line[nread-1]=='\n') line[nread-1]='\0';
+        addKeyword(keywords, count, line);
     }
     free(line);
+    fclose(patterns);
+    return true;
 }
 
 
 /**
- * @brief Converts a string to uppercase.
+ * @brief Checks whether the result for an input is already known.
  *
- * Allocates a new string where each character in the original string is converted to uppercase.
+ * For `-l` the first match decides, for `-m` the limit. Plain line output and `-c`
+ * without a limit have to see the whole input.
  *
- * @param str The original string.
- * @return Returns a newly allocated uppercase version of the string.
+ * @param s Search progress.
+ * @return true if searching the input can stop.
  */
-char* toUpperCase(const char *str) {
+bool searchDone(const search_t* s){
+    if(s->opts->mode==OUTPUT_FILES && s->matches>0) return true;
+    return s->opts->maxCount>=0 && s->matches>=s->opts->maxCount;
+}
 
-    char *upperStr = malloc(strlen(str) + 1); 
-    if(upperStr==NULL){
-        perror("Memory allocation failed");
-        exit(EXIT_FAILURE);
+
+/**
+ * @brief Writes the count (`-c`) or name (`-l`) of an input after it was searched.
+ *
+ * @param s Search progress of the finished input.
+ * @param name Name of the input.
+ */
+void searchReport(const search_t* s, const char* name){
+    if(s->opts->mode==OUTPUT_COUNT){
+        if(s->opts->withNames) fprintf(s->output, "%s:%ld\n", name, s->matches);
+        else fprintf(s->output, "%ld\n", s->matches);
+    }
+    else if(s->opts->mode==OUTPUT_FILES && s->matches>0){
+        fprintf(s->output, "%s\n", name);
     }
-    char *ptr=upperStr; 
+}
+
 
-    while(*str!='\0'){
-        *ptr++=tolower((unsigned char)*str++);
+/**
+ * @brief Searches one input file, memory-mapping it if possible.
+ *
+ * @param path Path of the input file.
+ * @param output Output file pointer.
+ * @param opts Search settings.
+ * @return false if the file could not be opened.
+ */
+bool searchFile(const char* path, FILE* output, const options_t* opts){
+    int fd=open(path, O_RDONLY);
+    if(fd==-1) return false;
+    searchFd(fd, path, output, opts);
+    close(fd);
+    return true;
+}
+
+
+/**
+ * @brief Searches an open input file, memory-mapping it if possible.
+ *
+ * Regular files up to `SMALL_FILE` bytes are read into a stack buffer, which is cheaper
+ * than setting up and tearing down a mapping; larger ones are mapped, everything else is
+ * streamed with `searchStream()`. Matching lines of a mapping are written without
+ * copying by a `writer_t` that is flushed before the mapping is released; lines of small
+ * files are cheaper to collect in the stdio buffer across files. Buffers larger than
+ * `PARALLEL_MIN_SIZE` are split into chunks if more than one thread is available. With
+ * `skipBinary` a file that has a NUL byte near its start is not searched and reported as
+ * having no match. The count or name of the file is reported afterwards.
+ *
+ * @param fd File descriptor of the input.
+ * @param name Name of the input.
+ * @param output Output file pointer.
+ * @param opts Search settings.
+ */
+void searchFd(int fd, const char* name, FILE* output, const options_t* opts){
+    search_t search = { .opts=opts, .output=output };
+    struct stat st;
+    char small[SMALL_FILE];
+    char* data=NULL;
+    size_t size=0;
+    bool mapped=false;
+
+    if(fstat(fd, &st)==0 && S_ISREG(st.st_mode) && st.st_size>0 && (unsigned long long)st.st_size<=SIZE_MAX){
+        if(st.st_size<=SMALL_FILE){
+            ssize_t n=1;
+            while(size<(size_t)st.st_size && (n=read(fd, small+size, st.st_size-size))!=0){
+                if(n==-1 && errno==EINTR) continue;
+                if(n==-1){
+                    perror("error in reading input");
+                    exit(EXIT_FAILURE);
+                }
+                size+=n;
+            }
+            data=small;
+        }
+        else if((data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))!=MAP_FAILED){
+            size=st.st_size;
+            mapped=true;
+        }
+        else{
+            data=NULL;
+        }
+    }
+
+    if(data==NULL){
+        searchStream(fd, &search);
+    }
+    else if(!opts->skipBinary || memchr(data, '\0', size<BINARY_SNIFF ? size : BINARY_SNIFF)==NULL){
+        /* each call takes one advice, so read-ahead and prefetching are asked for separately */
+        if(mapped){
+            madvise(data, size, MADV_SEQUENTIAL);
+            madvise(data, size, MADV_WILLNEED);
+        }
+        if(opts->threads>1 && size>=PARALLEL_MIN_SIZE){
+            searchBufferParallel(data, size, &search);
+        }
+        else{
+            writer_t writer;
+            if(mapped && writerInit(&writer, output, opts->flush)) search.writer=&writer;
+            searchBuffer(data, size, &search);
+            if(search.writer!=NULL) writerFlush(&writer);
+            search.writer=NULL;
+        }
     }
-    *ptr = '\0'; 
-    return upperStr;
+    if(mapped) munmap(data, size);
+    searchReport(&search, name);
 }
 
 
+/**
+ * @brief Writes a run of matching lines, by reference if the search has a writer.
+ *
+ * A run that does not end with a newline ends at the end of the input; the missing
+ * newline is added, so the line is not joined with the output of the next input.
+ */
+static void writeRun(search_t* s, const char* data, size_t len){
+    if(len==0) return;
+    if(s->writer!=NULL){
+        writerAdd(s->writer, data, len);
+        if(data[len-1]!='\n') writerAdd(s->writer, "\n", 1);
+    }
+    else{
+        fwrite(data, len, 1, s->output);
+        if(data[len-1]!='\n') fputc('\n', s->output);
+    }
+}
+
+
+/**
+ * @struct run
+ * @brief Adjacent matching lines of a `searchBuffer()` call that are not written yet.
+ */
+typedef struct run {
+    search_t* s;
+    const char* data;
+    size_t start;
+    size_t end;
+    bool done;
+} run_t;
+
+
+/**
+ * @brief Callback of `pattern_search()`: counts a matching line and extends the current
+ * run with it, writing the run first if the line does not follow it directly.
+ *
+ * @return false once `searchDone()` became true.
+ */
+static bool addLine(const pattern_match_t* m, void* arg){
+    run_t* run=arg;
 
+    run->s->matches++;
+    run->done=searchDone(run->s);
+    if(run->s->opts->mode==OUTPUT_LINES){
+        if(m->line!=run->end){
+            writeRun(run->s, run->data+run->start, run->end-run->start);
+            run->start=m->line;
+        }
+        run->end=m->line+m->line_len;
+    }
+    return !run->done;
+}
+
+
+/**
+ * @brief Searches a whole buffer and writes every line that contains the keyword.
+ *
+ * The lines are found by `pattern_search()`. Adjacent matching lines are collected into
+ * one run and written with a single `fwrite()`; with `-c` and `-l` nothing is written at
+ * all.
+ *
+ * @param data Start of the buffer.
+ * @param len Length of the buffer.
+ * @param s Search progress.
+ * @return true if searching stopped early because `searchDone()` became true.
+ */
+bool searchBuffer(const char* data, size_t len, search_t* s){
+    run_t run = { .s=s, .data=data, .done=searchDone(s) };
+
+    if(!run.done) pattern_search(s->opts->pattern, data, len, addLine, &run);
+    writeRun(s, data+run.start, run.end-run.start);
+    return run.done;
+}
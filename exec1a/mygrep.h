@@ -7,6 +7,13 @@
  * This file contains function declarations and necessary includes for the `mygrep` program,
  * which searches for a specified keyword in lines of text from input files or stdin.
  * It supports case-insensitive searching with the `-i` option and output redirection with `-o`.
+ * Several keywords can be given with `-e` or `-f`, they are searched in a single pass.
+ * Regular files are memory-mapped and searched in one piece, pipes and stdin are streamed.
+ * With `-j` several input files, or chunks of a single large file, are searched in parallel,
+ * the output order stays the same. `-c`, `-l` and `-m` stop searching an input as soon as
+ * the answer is known.
+ * The search itself lives in the `libmygrep.a` library (`pattern.h`), the program is the
+ * command line and input handling around it.
  */
 
 #include <stdio.h>
@@ -16,6 +23,64 @@
 #include <getopt.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pattern.h"
+#include "output.h"
+
+/** Regular files up to this size are read instead of memory-mapped. */
+#define SMALL_FILE (16 * 1024)
+/** Number of bytes at the start of a file that are checked for a NUL byte. */
+#define BINARY_SNIFF 4096
+
+/**
+ * @enum OUTPUT_MODE
+ * @brief What is written for an input.
+ */
+typedef enum OUTPUT_MODE {
+    OUTPUT_LINES = 0,   /**< every matching line */
+    OUTPUT_COUNT = 1,   /**< the number of matching lines (`-c`) */
+    OUTPUT_FILES = 2    /**< the name of the input if it matches (`-l`) */
+} output_mode_t;
+
+/**
+ * @struct options
+ * @brief Search settings shared by all inputs of one run.
+ *
+ * @details `maxCount` is the `-m` limit, or -1 if there is none. `withNames` prefixes the
+ * counts of `-c` with the input name, it is set if there is more than one input.
+ * `skipBinary` skips files whose first `BINARY_SNIFF` bytes contain a NUL byte. `flush`
+ * decides whether matching lines are written immediately or in batches.
+ */
+typedef struct options {
+    const pattern_t* pattern;
+    output_mode_t mode;
+    long maxCount;
+    bool withNames;
+    int threads;
+    bool skipBinary;
+    flush_policy_t flush;
+} options_t;
+
+/**
+ * @struct search
+ * @brief Progress of searching one input.
+ *
+ * @details If `writer` is set, matching lines are queued there by reference instead of
+ * being copied to `output`; the searched buffer then has to stay valid until the writer
+ * is flushed.
+ */
+typedef struct search {
+    const options_t* opts;
+    FILE* output;
+    long matches;
+    writer_t* writer;
+} search_t;
 
 /**
  * @brief Prints usage information and exits the program.
@@ -26,30 +91,80 @@
  * @param myprog The name of the program (usually argv[0]).
  * @param errormsg The specific error message to display.
  */
-void usage(char *myprog, char* errormsg);
+void usage(char *myprog, const char* errormsg);
+
+/**
+ * @brief Appends a copy of `keyword` to a growing keyword array.
+ *
+ * @param keywords Pointer to the array, reallocated as needed.
+ * @param count Pointer to the number of keywords in the array.
+ * @param keyword The keyword to copy.
+ */
+void addKeyword(char*** keywords, int* count, const char* keyword);
 
 /**
- * @brief Reads lines from the input file and searches for the keyword.
+ * @brief Reads one keyword per line from a pattern file (`-f`).
  *
- * This function reads each line from the provided input file and checks if it contains
- * the keyword. Matching lines are written to the output file.
+ * @param path Path of the pattern file.
+ * @param keywords Pointer to the keyword array, reallocated as needed.
+ * @param count Pointer to the number of keywords in the array.
+ * @return false if the file could not be opened.
+ */
+bool readKeywords(const char* path, char*** keywords, int* count);
+
+/**
+ * @brief Checks whether the result for an input is already known.
+ *
+ * @param s Search progress.
+ * @return true once `-l` has seen a match or `-m` matches were found.
+ */
+bool searchDone(const search_t* s);
+
+/**
+ * @brief Writes the count (`-c`) or name (`-l`) of an input after it was searched.
+ *
+ * @param s Search progress of the finished input.
+ * @param name Name of the input.
+ */
+void searchReport(const search_t* s, const char* name);
+
+/**
+ * @brief Searches one input file, memory-mapping it if possible.
+ *
+ * Small regular files are read, larger ones mapped; the bytes are handed to
+ * `searchBuffer()`, or split across `opts->threads` threads by `searchBufferParallel()`
+ * if they are large. Everything else (pipes, devices, empty files) goes through the
+ * block-based `searchStream()`.
+ *
+ * @param path Path of the input file.
+ * @param output Output file pointer.
+ * @param opts Search settings.
+ * @return false if the file could not be opened.
+ */
+bool searchFile(const char* path, FILE* output, const options_t* opts);
+
+/**
+ * @brief Searches an already opened input file like `searchFile()`.
  *
- * @param input Input file pointer (either stdin or an opened file).
- * @param output Output file pointer (either stdout or an opened file).
- * @param caseInsensitive If true, the search is case-insensitive.
- * @param keyword The keyword to search for in each line.
+ * @param fd File descriptor of the input, it is not closed.
+ * @param name Name of the input for `-c` and `-l`.
+ * @param output Output file pointer.
+ * @param opts Search settings.
  */
-void readLine(FILE * input, FILE* output, bool caseInsensitive ,char* keyword);
+void searchFd(int fd, const char* name, FILE* output, const options_t* opts);
 
 /**
- * @brief Converts a string to uppercase.
+ * @brief Searches a whole buffer and writes every line that contains the keyword.
  *
- * Allocates a new string where each character in the original string is converted
- * to uppercase. The caller is responsible for freeing the allocated memory.
+ * The matching lines are found by `pattern_search()` of the library and written straight
+ * from the buffer unless only counts or names are wanted. The buffer must start at the
+ * beginning of a line.
  *
- * @param str The original string.
- * @return A newly allocated uppercase version of the string.
+ * @param data Start of the buffer, e.g. a file mapping.
+ * @param len Length of the buffer.
+ * @param s Search progress, `s->matches` is increased for every matching line.
+ * @return true if searching stopped early because `searchDone()` became true.
  */
-char* toUpperCase(const char *str);
+bool searchBuffer(const char* data, size_t len, search_t* s);
 
 #endif // MYGREP_H
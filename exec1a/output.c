@@ -0,0 +1,96 @@
+/**
+ * @file output.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Zero-copy batched writer for matching lines.
+ *
+ * Adjacent runs are merged into one `iovec`, so a block of consecutive matching lines
+ * costs a single entry. `writev()` may write less than requested; the entries that were
+ * written completely are dropped and the first partial one is advanced before retrying.
+ */
+
+#include "output.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+
+/**
+ * @brief Line buffering for `FLUSH_LINES`, otherwise a buffer of `OUTPUT_BUFFER` bytes so
+ * that counts, names and streamed lines are written in large blocks.
+ */
+void outputSetup(FILE* output, flush_policy_t policy){
+    if(policy==FLUSH_LINES) setvbuf(output, NULL, _IOLBF, BUFSIZ);
+    else setvbuf(output, NULL, _IOFBF, OUTPUT_BUFFER);
+}
+
+
+/**
+ * @brief Starts with no queued bytes; the writer writes to the descriptor of `file`
+ * directly and only flushes `file` itself to keep the order of the output.
+ */
+bool writerInit(writer_t* w, FILE* file, flush_policy_t policy){
+    w->file=file;
+    w->fd=fileno(file);
+    w->policy=policy;
+    w->count=0;
+    return w->fd>=0;
+}
+
+
+/**
+ * @brief Appends to the last entry if the bytes directly follow it, otherwise takes a new
+ * entry and flushes first if all are in use.
+ *
+ * @details Only the address is queued, so the buffer holding the bytes must stay valid
+ * and unchanged until `writerFlush()` has returned. With `FLUSH_LINES` every call flushes.
+ */
+void writerAdd(writer_t* w, const char* data, size_t len){
+    if(len==0) return;
+    if(w->count>0 && (const char*)w->iov[w->count-1].iov_base+w->iov[w->count-1].iov_len==data){
+        w->iov[w->count-1].iov_len+=len;
+    }
+    else{
+        if(w->count==WRITER_IOV) writerFlush(w);
+        w->iov[w->count].iov_base=(void*)data;
+        w->iov[w->count].iov_len=len;
+        w->count++;
+    }
+    if(w->policy==FLUSH_LINES) writerFlush(w);
+}
+
+
+/**
+ * @brief Flushes the stdio stream, then writes the queued entries and retries after
+ * partial writes until everything is out.
+ *
+ * @details Afterwards the writer no longer refers to any buffer, so the caller may release
+ * or reuse what it had queued.
+ */
+void writerFlush(writer_t* w){
+    struct iovec* iov=w->iov;
+    int count=w->count;
+
+    if(count==0) return;
+    fflush(w->file);
+    while(count>0){
+        ssize_t n=writev(w->fd, iov, count);
+        if(n==-1){
+            if(errno==EINTR) continue;
+            perror("error in writing output");
+            exit(EXIT_FAILURE);
+        }
+        while(count>0 && (size_t)n>=iov->iov_len){
+            n-=iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count>0){
+            iov->iov_base=(char*)iov->iov_base+n;
+            iov->iov_len-=n;
+        }
+    }
+    w->count=0;
+}
@@ -0,0 +1,75 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+/**
+ * @file output.h
+ * @brief Batched output of matching lines with `writev()`.
+ *
+ * Matching lines of a memory-mapped or otherwise stable input buffer are not copied: the
+ * writer only records where they are and writes up to `WRITER_IOV` of them with a single
+ * `writev()` call. The caller flushes the writer before the buffer goes away. Everything
+ * else (counts, names, lines from transient stream buffers) still goes through the stdio
+ * stream, which is flushed before every `writev()` so the order of the output is kept.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+/** Number of pending line runs that triggers a `writev()`. */
+#define WRITER_IOV 1024
+/** Size of the stdio buffer of the output stream in bulk mode. */
+#define OUTPUT_BUFFER (1 << 20)
+
+/**
+ * @enum FLUSH_POLICY
+ * @brief When matching lines reach the output.
+ */
+typedef enum FLUSH_POLICY {
+    FLUSH_BULK = 0,     /**< in large batches, for pipes and files */
+    FLUSH_LINES = 1     /**< as soon as they are found, for terminals and `--line-buffered` */
+} flush_policy_t;
+
+/**
+ * @struct writer
+ * @brief Pending references to output bytes, written to `fd` in one batch.
+ */
+typedef struct writer {
+    FILE* file;
+    int fd;
+    flush_policy_t policy;
+    int count;
+    struct iovec iov[WRITER_IOV];
+} writer_t;
+
+/**
+ * @brief Sets the stdio buffering of the output stream according to `policy`.
+ *
+ * @param output Output stream, before anything was written to it.
+ * @param policy Flush policy of the run.
+ */
+void outputSetup(FILE* output, flush_policy_t policy);
+
+/**
+ * @brief Prepares a writer for the output stream `file`.
+ *
+ * @param w The writer.
+ * @param file Output stream.
+ * @param policy Flush policy of the run.
+ * @return false if `file` has no file descriptor (e.g. a memory stream); the writer must
+ * not be used then.
+ */
+bool writerInit(writer_t* w, FILE* file, flush_policy_t policy);
+
+/**
+ * @brief Queues `len` bytes at `data` for output without copying them.
+ *
+ * @details The bytes must stay valid until the next `writerFlush()`.
+ */
+void writerAdd(writer_t* w, const char* data, size_t len);
+
+/**
+ * @brief Writes all queued bytes.
+ */
+void writerFlush(writer_t* w);
+
+#endif // OUTPUT_H
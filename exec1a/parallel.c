@@ -0,0 +1,307 @@
+/**
+ * @file parallel.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Worker pool that searches several input files, or byte ranges of one large
+ * file, concurrently.
+ *
+ * Every worker takes the next job, searches it into an `open_memstream()` buffer with the
+ * normal `searchFile()` or `searchBuffer()` routine and marks the job as done. The calling
+ * thread waits for the jobs strictly in order and hands each finished job to a flush
+ * function, which writes it to the real output and may stop the pool early.
+ */
+
+#include "parallel.h"
+
+/** How many jobs the workers may run ahead of the oldest unflushed job, per thread. */
+#define WINDOW_PER_THREAD 4
+/** Chunk size bounds for splitting a single file. */
+#define MIN_CHUNK (1UL << 20)
+#define MAX_CHUNK (16UL << 20)
+
+/**
+ * @struct job
+ * @brief Result of searching one input file or one chunk of a mapping.
+ *
+ * @details File jobs have a `path`, chunk jobs a byte range `data`/`size` that starts at
+ * the beginning of a line and ends after a newline (or at the end of the file). `matches`
+ * is the number of matching lines of a chunk; file jobs report their counts themselves.
+ */
+typedef struct job {
+    const char* path;
+    const char* data;
+    size_t size;
+    char* buf;
+    size_t len;
+    long matches;
+    bool taken;
+    bool done;
+    bool failed;
+} job_t;
+
+/**
+ * @brief Writes a finished job to the output.
+ *
+ * @return true if no further jobs are needed.
+ */
+typedef bool (*flush_fn)(job_t* job, void* ctx);
+
+/**
+ * @struct pool
+ * @brief State shared between the flushing thread and the workers, guarded by `lock`.
+ *
+ * @details With `stopOnMatch` (chunks of one file searched with `-l`) the first chunk that
+ * matches stops the pool, whatever its position.
+ */
+typedef struct pool {
+    job_t* jobs;
+    int count;
+    int next;
+    int flushed;
+    int window;
+    bool stop;
+    bool stopOnMatch;
+    const options_t* opts;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} pool_t;
+
+
+/**
+ * @brief Searches one file or chunk into a memory buffer.
+ *
+ * @param job The job to fill in.
+ * @param opts Search settings.
+ */
+static void runJob(job_t* job, const options_t* opts){
+    FILE* mem=open_memstream(&job->buf, &job->len);
+    if(mem==NULL){
+        perror("error in opening memory stream");
+        exit(EXIT_FAILURE);
+    }
+    if(job->path!=NULL){
+        options_t single=*opts;
+        single.threads=1;
+        job->failed=!searchFile(job->path, mem, &single);
+    }
+    else{
+        search_t search = { .opts=opts, .output=mem };
+        searchBuffer(job->data, job->size, &search);
+        job->matches=search.matches;
+    }
+    if(fclose(mem)==EOF){
+        perror("error in closing memory stream");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/**
+ * @brief Worker thread, takes jobs until all jobs are taken or the pool is stopped.
+ *
+ * @param arg The shared `pool_t`.
+ * @return NULL.
+ */
+static void* worker(void* arg){
+    pool_t* pool=arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while(!pool->stop && pool->next < pool->count){
+        if(pool->next >= pool->flushed + pool->window){
+            pthread_cond_wait(&pool->changed, &pool->lock);
+            continue;
+        }
+        job_t* job=&pool->jobs[pool->next++];
+        job->taken=true;
+        pthread_mutex_unlock(&pool->lock);
+
+        runJob(job, pool->opts);
+
+        pthread_mutex_lock(&pool->lock);
+        job->done=true;
+        if(pool->stopOnMatch && job->matches>0) pool->stop=true;
+        pthread_cond_broadcast(&pool->changed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+
+/**
+ * @brief Runs `count` prepared jobs on the worker threads and flushes the results in order.
+ *
+ * @param pool Pool with `jobs`, `count`, `opts` and `stopOnMatch` filled in.
+ * @param flush Called for every finished job in order, returns true to stop the pool.
+ * @param ctx Passed to `flush`.
+ * @return Index of the first job whose file could not be opened, or -1.
+ */
+static int runPool(pool_t* pool, flush_fn flush, void* ctx){
+    int threads=pool->opts->threads;
+    pthread_t* tids=malloc(threads*sizeof(*tids));
+    int failed=-1;
+    int i=0;
+
+    if(tids==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    pool->window=threads*WINDOW_PER_THREAD;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+
+    for(; i<threads; i++){
+        if(pthread_create(&tids[i], NULL, worker, pool)!=0){
+            perror("error in creating worker thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for(i=0; i<pool->count; i++){
+        job_t* job=&pool->jobs[i];
+        bool stop;
+
+        pthread_mutex_lock(&pool->lock);
+        while(!job->done && !(pool->stop && !job->taken)) pthread_cond_wait(&pool->changed, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+
+        if(!job->done) break;
+        if(job->failed){
+            failed=i;
+            break;
+        }
+        stop=flush(job, ctx);
+        free(job->buf);
+        job->buf=NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->flushed=i+1;
+        if(stop) pool->stop=true;
+        pthread_cond_broadcast(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+        if(stop) break;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop=true;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    for(i=0; i<threads; i++) pthread_join(tids[i], NULL);
+
+    for(i=0; i<pool->count; i++){
+        free(pool->jobs[i].buf);
+        pool->jobs[i].buf=NULL;
+    }
+    pthread_cond_destroy(&pool->changed);
+    pthread_mutex_destroy(&pool->lock);
+    free(tids);
+    return failed;
+}
+
+
+/**
+ * @brief Copies the complete output of a file job, including its `-c`/`-l` report.
+ */
+static bool flushFile(job_t* job, void* ctx){
+    fwrite(job->buf, job->len, 1, (FILE*)ctx);
+    return false;
+}
+
+
+/**
+ * @brief Adds a chunk to the search of its file, honouring the `-m` limit across chunks.
+ *
+ * Every chunk was searched with the full limit, so only the first lines of the chunk that
+ * crosses the limit are kept.
+ */
+static bool flushChunk(job_t* job, void* ctx){
+    search_t* s=ctx;
+    long take=job->matches;
+    size_t len=job->len;
+
+    if(s->opts->maxCount>=0 && s->matches+take > s->opts->maxCount){
+        take=s->opts->maxCount-s->matches;
+        if(s->opts->mode==OUTPUT_LINES){
+            const char* p=job->buf;
+            long i=0;
+            for(; i<take; i++) p=(const char*)memchr(p, '\n', job->buf+job->len-p)+1;
+            len=p-job->buf;
+        }
+    }
+    if(s->opts->mode==OUTPUT_LINES) fwrite(job->buf, len, 1, s->output);
+    s->matches+=take;
+    return searchDone(s);
+}
+
+
+/**
+ * @brief Searches `paths` with `opts->threads` worker threads and flushes the results in order.
+ *
+ * @param paths Input files.
+ * @param count Number of input files.
+ * @param output Output file pointer.
+ * @param opts Search settings.
+ * @return Index of the first file that could not be opened, or -1.
+ */
+int searchFilesParallel(char* const paths[], int count, FILE* output, const options_t* opts){
+    pool_t pool = { .count=count, .opts=opts };
+    int failed;
+    int i=0;
+
+    pool.jobs=calloc(count, sizeof(*pool.jobs));
+    if(pool.jobs==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for(; i<count; i++) pool.jobs[i].path=paths[i];
+    failed=runPool(&pool, flushFile, output);
+    free(pool.jobs);
+    return failed;
+}
+
+
+/**
+ * @brief Splits a buffer into newline-aligned chunks and searches them in parallel.
+ *
+ * The nominal chunk size gives every thread several chunks, so an uneven distribution of
+ * matches does not leave threads idle. Each nominal boundary is moved forward to just
+ * after the next newline, so every line belongs to exactly one chunk.
+ *
+ * @param data Start of the buffer.
+ * @param len Length of the buffer.
+ * @param s Search progress of the file the buffer belongs to.
+ */
+void searchBufferParallel(const char* data, size_t len, search_t* s){
+    pool_t pool = { .opts=s->opts, .stopOnMatch= s->opts->mode==OUTPUT_FILES };
+    size_t chunk=len/((size_t)s->opts->threads*WINDOW_PER_THREAD);
+    size_t maxjobs, start=0;
+
+    chunk= chunk<MIN_CHUNK ? MIN_CHUNK : chunk>MAX_CHUNK ? MAX_CHUNK : chunk;
+    maxjobs=len/chunk+1;
+    if(maxjobs>INT_MAX) maxjobs=INT_MAX;
+    pool.jobs=calloc(maxjobs, sizeof(*pool.jobs));
+    if(pool.jobs==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    while(start<len && (size_t)pool.count<maxjobs){
+        size_t end= len-start<=chunk || (size_t)pool.count==maxjobs-1 ? len : start+chunk;
+        if(end<len){
+            const char* eol=memchr(data+end-1, '\n', len-end+1);
+            end= eol==NULL ? len : (size_t)(eol-data)+1;
+        }
+        pool.jobs[pool.count].data=data+start;
+        pool.jobs[pool.count].size=end-start;
+        pool.count++;
+        start=end;
+    }
+    runPool(&pool, flushChunk, s);
+
+    /* with -l a later chunk may have stopped the pool before the earlier ones were flushed */
+    if(pool.stopOnMatch && s->matches==0){
+        int i=0;
+        for(; i<pool.count; i++) if(pool.jobs[i].done && pool.jobs[i].matches>0) s->matches=1;
+    }
+    free(pool.jobs);
+}
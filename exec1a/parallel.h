@@ -0,0 +1,50 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+/**
+ * @file parallel.h
+ * @brief Multi-threaded search for `mygrep`.
+ *
+ * Input files, or newline-aligned chunks of a single large file, are searched by a pool
+ * of worker threads. Every job writes its matches into its own memory buffer, the calling
+ * thread flushes those buffers in input order, so the output is byte-identical to a
+ * sequential run.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "mygrep.h"
+
+/** Files smaller than this are not worth splitting into chunks. */
+#define PARALLEL_MIN_SIZE (4L << 20)
+
+/**
+ * @brief Searches `paths` with `threads` worker threads.
+ *
+ * @details Results are written to `output` in the order of `paths`. Workers never run
+ * more than a few files ahead of the oldest unflushed file, which bounds the amount of
+ * buffered output.
+ *
+ * @param paths Input files.
+ * @param count Number of input files.
+ * @param output Output file pointer.
+ * @param opts Search settings, `opts->threads` is the number of worker threads.
+ * @return Index of the first file that could not be opened, or -1 if all were searched.
+ */
+int searchFilesParallel(char* const paths[], int count, FILE* output, const options_t* opts);
+
+/**
+ * @brief Searches one large buffer, e.g. a file mapping, with `s->opts->threads` threads.
+ *
+ * @details The buffer is split into byte ranges that are snapped to line boundaries,
+ * matches are written in their original order. `-m` is applied across the chunks in
+ * order, `-l` stops all threads at the first match found anywhere.
+ *
+ * @param data Start of the buffer.
+ * @param len Length of the buffer.
+ * @param s Search progress of the file the buffer belongs to.
+ */
+void searchBufferParallel(const char* data, size_t len, search_t* s);
+
+#endif // PARALLEL_H
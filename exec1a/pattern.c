@@ -0,0 +1,97 @@
+/**
+ * @file pattern.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Line search over memory buffers on top of the compiled matcher.
+ */
+
+#include "pattern.h"
+
+#include <string.h>
+
+/**
+ * @brief Copies the keywords, so the caller's array does not have to outlive the pattern,
+ * and compiles them.
+ */
+const char *pattern_compile(pattern_t *p, const char *const keywords[], int count, int flags) {
+    const char *error;
+    int i = 0;
+
+    p->count = count;
+    p->keywords = calloc(count > 0 ? count : 1, sizeof(*p->keywords));
+    if (p->keywords == NULL) return "out of memory";
+    for (error = NULL; i < count && error == NULL; i++) {
+        if ((p->keywords[i] = strdup(keywords[i])) == NULL) error = "out of memory";
+    }
+    if (error == NULL) {
+        error = matcher_compile(&p->matcher, p->keywords, count, flags & PATTERN_NOCASE, flags & PATTERN_REGEX);
+    }
+    if (error != NULL) {
+        for (i = 0; i < count; i++) free(p->keywords[i]);
+        free(p->keywords);
+        p->keywords = NULL;
+        p->count = 0;
+    }
+    return error;
+}
+
+/**
+ * @brief Scans the whole rest of the buffer for the next hit and looks up the line
+ * boundaries only around it.
+ *
+ * If a keyword contains a newline, a match in the whole buffer could span two lines, so
+ * the buffer is then searched line by line.
+ */
+size_t pattern_search(const pattern_t *p, const char *data, size_t len, pattern_callback_t cb, void *arg) {
+    const matcher_t *matcher = &p->matcher;
+    const char *pos = data, *end = data + len;
+    size_t found = 0;
+
+    while (pos < end) {
+        const char *start, *eol, *hit;
+        pattern_match_t m;
+
+        if (matcher->multiline) {
+            eol = memchr(pos, '\n', end - pos);
+            eol = eol == NULL ? end : eol + 1;
+            start = pos;
+            pos = eol;
+            if ((hit = matcher_find(matcher, start, eol - start)) == NULL) continue;
+        } else {
+            if ((hit = matcher_find(matcher, pos, end - pos)) == NULL) break;
+            start = hit;
+            while (start > pos && start[-1] != '\n') start--;
+            eol = memchr(hit, '\n', end - hit);
+            eol = eol == NULL ? end : eol + 1;
+            pos = eol;
+        }
+
+        m.line = start - data;
+        m.line_len = eol - start;
+        m.offset = matcher->kind == MATCH_REGEX ? m.line : (size_t)(hit - data);
+        found++;
+        if (!cb(&m, arg)) break;
+    }
+    return found;
+}
+
+/**
+ * @brief Runs the matcher over the given bytes, without looking for line boundaries.
+ */
+bool pattern_matches(const pattern_t *p, const char *line, size_t len) {
+    return matcher_find(&p->matcher, line, len) != NULL;
+}
+
+/**
+ * @brief Frees the matcher and the keyword copies.
+ */
+void pattern_free(pattern_t *p) {
+    int i = 0;
+
+    if (p->keywords == NULL) return;
+    matcher_free(&p->matcher);
+    for (; i < p->count; i++) free(p->keywords[i]);
+    free(p->keywords);
+    p->keywords = NULL;
+}
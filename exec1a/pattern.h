@@ -0,0 +1,110 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+/**
+ * @file pattern.h
+ * @brief Embeddable line search, the library behind `mygrep`.
+ *
+ * A pattern is compiled once from one or more keywords (or `-E` regular expressions) and
+ * can then search any number of memory buffers, from any number of threads, without
+ * allocating. `pattern_search()` finds the lines of a buffer that match and hands their
+ * offsets to a callback, the buffer itself is never copied. A program that filters data
+ * it already holds in memory links `libmygrep.a` and needs neither a `mygrep` process nor
+ * a pipe to it.
+ *
+ * Example:
+ *
+ *     pattern_t p;
+ *     const char *kw[] = { "ERROR" };
+ *     if (pattern_compile(&p, kw, 1, PATTERN_NOCASE) == NULL) {
+ *         pattern_search(&p, buf, len, on_match, ctx);
+ *         pattern_free(&p);
+ *     }
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "matcher.h"
+
+/** Flags for `pattern_compile()`. */
+#define PATTERN_NOCASE 1    /**< ASCII letters match regardless of their case */
+#define PATTERN_REGEX 2     /**< the keywords are extended regular expressions */
+
+/**
+ * @struct pattern
+ * @brief A compiled pattern, owning copies of its keywords.
+ */
+typedef struct pattern {
+    matcher_t matcher;
+    char **keywords;
+    int count;
+} pattern_t;
+
+/**
+ * @struct pattern_match
+ * @brief One matching line, as byte offsets into the searched buffer.
+ *
+ * @details The line spans `[line, line + line_len)` including its newline, the last line
+ * of a buffer may lack one. `offset` is where the first keyword occurrence in the line
+ * starts; regular expressions only decide whether a line matches, for them it is `line`.
+ */
+typedef struct pattern_match {
+    size_t line;
+    size_t line_len;
+    size_t offset;
+} pattern_match_t;
+
+/**
+ * @brief Receives a matching line.
+ *
+ * @param m The matching line, only valid during the call.
+ * @param arg The argument given to `pattern_search()`.
+ * @return true to continue searching, false to stop.
+ */
+typedef bool (*pattern_callback_t)(const pattern_match_t *m, void *arg);
+
+/**
+ * @brief Compiles the keywords; a line matches if it contains any of them.
+ *
+ * @param p The pattern to initialise.
+ * @param keywords The keywords, NUL-terminated; they are copied.
+ * @param count Number of keywords; with 0 keywords nothing matches.
+ * @param flags `PATTERN_NOCASE` and `PATTERN_REGEX`, ORed together.
+ * @return NULL on success, otherwise a message describing an invalid regular expression,
+ * a pattern too large to compile or "out of memory" (`errno` is `ENOMEM` then). Nothing
+ * has to be freed after an error; the library never terminates the program.
+ */
+const char *pattern_compile(pattern_t *p, const char *const keywords[], int count, int flags);
+
+/**
+ * @brief Finds the matching lines of a buffer in order and reports each to `cb`.
+ *
+ * @details The buffer has to start at the beginning of a line. Every line is reported at
+ * most once, however many keyword occurrences it has.
+ *
+ * @param p A compiled pattern.
+ * @param data Start of the buffer.
+ * @param len Length of the buffer.
+ * @param cb Callback for every matching line.
+ * @param arg Passed to `cb`.
+ * @return Number of matching lines reported, including the one whose callback stopped
+ * the search.
+ */
+size_t pattern_search(const pattern_t *p, const char *data, size_t len, pattern_callback_t cb, void *arg);
+
+/**
+ * @brief Checks whether a single line matches.
+ *
+ * @param p A compiled pattern.
+ * @param line Start of the line.
+ * @param len Length of the line, a trailing newline may be included.
+ * @return true if the line matches.
+ */
+bool pattern_matches(const pattern_t *p, const char *line, size_t len);
+
+/**
+ * @brief Releases the memory held by a pattern.
+ */
+void pattern_free(pattern_t *p);
+
+#endif // PATTERN_H
@@ -0,0 +1,1233 @@
+/**
+ * @file regexp.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Parsing, literal extraction, DFA construction and matching of `-E` patterns.
+ *
+ * Patterns are parsed by recursive descent into a syntax tree whose leaves are byte sets.
+ * The tree is compiled into a Thompson NFA (`OP_SET`, `OP_SPLIT`, `OP_JMP`, the anchors
+ * and `OP_MATCH`); counted repeats are expanded into copies. A DFA state is the sorted set
+ * of NFA instructions that are waiting for the next byte. Every state also contains the
+ * start of the pattern, which makes the search unanchored without a leading `.*`.
+ *
+ * Newlines never enter a byte set, so a match always lies within one line, and a newline
+ * either accepts the line (if `$` completes a match) or leads back to the line start state.
+ * This lets one table walk search a whole buffer of lines.
+ */
+
+#include "regexp.h"
+
+#include <string.h>
+#include <ctype.h>
+#include <sched.h>
+
+/** Largest NFA, counted after expanding `{m,n}`. */
+#define MAX_INST (1 << 20)
+/** Largest bound in `{m,n}`, as RE_DUP_MAX. */
+#define MAX_REPEAT 255
+/** Deepest nesting of groups. */
+#define MAX_DEPTH 200
+/** Largest DFA before falling back to simulating the NFA. */
+#define MAX_STATES 4096
+/** Budget of NFA instructions visited while building the DFA. */
+#define MAX_WORK (1L << 26)
+/** Largest prefilter literal set, and its longest literal. */
+#define MAX_LITS 64
+#define MAX_LIT_LEN 256
+/** Bracket expressions with at most this many bytes still count as literals. */
+#define MAX_CLASS_LITS 4
+
+enum { NODE_SET, NODE_CAT, NODE_ALT, NODE_REPEAT, NODE_BOL, NODE_EOL, NODE_EMPTY };
+enum { OP_SET, OP_SPLIT, OP_JMP, OP_BOL, OP_EOL, OP_MATCH };
+
+/**
+ * @struct node
+ * @brief Syntax tree node; `a` is the byte set of a `NODE_SET` or the (left) child.
+ */
+typedef struct node {
+    int type;
+    int a, b;
+    int min, max;
+} node_t;
+
+/**
+ * @struct inst
+ * @brief NFA instruction. `OP_SET` consumes a byte of set `x` and continues at the next
+ * instruction, `OP_SPLIT` continues at `x` and `y`, `OP_JMP` at `x`.
+ */
+typedef struct inst {
+    int op;
+    int32_t x, y;
+} inst_t;
+
+/**
+ * @struct regexp_prog
+ * @brief The NFA and its byte sets (32-byte bitmaps); the last instruction is `OP_MATCH`.
+ *
+ * @details If the NFA is simulated, `spare` is the memory for one search at a time, `busy`
+ * is set while a search uses it.
+ */
+struct regexp_prog {
+    inst_t *inst;
+    int32_t ninst;
+    int32_t capinst;
+    uint8_t (*sets)[32];
+    int nsets;
+    int capsets;
+    struct scratch *spare;
+    bool busy;
+};
+
+/**
+ * @struct parser
+ * @brief State while parsing and compiling; `error` is set on the first error.
+ */
+typedef struct parser {
+    const unsigned char *s;
+    bool nocase;
+    const char *error;
+    int depth;
+    node_t *nodes;
+    int nnodes;
+    int capnodes;
+    struct regexp_prog *prog;
+} parser_t;
+
+/**
+ * @struct litset
+ * @brief Set of literals of which every match contains one. If `exact` is set, the
+ * node matches exactly these strings.
+ */
+typedef struct litset {
+    int n;
+    char *s[MAX_LITS];
+    bool exact;
+} litset_t;
+
+/**
+ * @struct work
+ * @brief Scratch memory for computing NFA state sets.
+ */
+typedef struct work {
+    int32_t *stack;
+    int32_t *next;
+    uint32_t *mark;
+    uint32_t gen;
+    long visited;
+} work_t;
+
+/**
+ * @struct scratch
+ * @brief Memory for simulating the NFA in one search: work space and the two state sets.
+ */
+typedef struct scratch {
+    work_t w;
+    int32_t *cur;
+    int32_t *next;
+} scratch_t;
+
+
+static inline bool in_set(const uint8_t *set, unsigned char c) {
+    return (set[c >> 3] >> (c & 7)) & 1;
+}
+
+static inline void set_add(uint8_t *set, unsigned char c) {
+    set[c >> 3] |= (uint8_t)(1 << (c & 7));
+}
+
+/* ---------------------------------------------------------------- parsing */
+
+/**
+ * @brief Appends a syntax tree node.
+ *
+ * @return Its index, or -1 with `p->error` set if memory ran out.
+ */
+static int add_node(parser_t *p, int type, int a, int b) {
+    if (p->nnodes == p->capnodes) {
+        int cap = p->capnodes > 0 ? 2 * p->capnodes : 64;
+        node_t *nodes = realloc(p->nodes, cap * sizeof(*nodes));
+        if (nodes == NULL) {
+            p->error = "out of memory";
+            return -1;
+        }
+        p->nodes = nodes;
+        p->capnodes = cap;
+    }
+    p->nodes[p->nnodes] = (node_t){ .type = type, .a = a, .b = b };
+    return p->nnodes++;
+}
+
+/**
+ * @brief Adds the other case of every letter in the set for `-i`.
+ */
+static void fold_set(const parser_t *p, uint8_t *set) {
+    int c = 'a';
+
+    if (!p->nocase) return;
+    for (; c <= 'z'; c++) {
+        if (in_set(set, c) || in_set(set, toupper(c))) {
+            set_add(set, c);
+            set_add(set, toupper(c));
+        }
+    }
+}
+
+/**
+ * @brief Adds a byte set node; the set is closed under case folding for `-i` and never
+ * contains a newline.
+ */
+static int add_set(parser_t *p, const uint8_t *set) {
+    struct regexp_prog *g = p->prog;
+    uint8_t *copy;
+
+    if (g->nsets == g->capsets) {
+        int cap = g->capsets > 0 ? 2 * g->capsets : 16;
+        uint8_t (*sets)[32] = realloc(g->sets, cap * sizeof(*sets));
+        if (sets == NULL) {
+            p->error = "out of memory";
+            return -1;
+        }
+        g->sets = sets;
+        g->capsets = cap;
+    }
+    copy = g->sets[g->nsets];
+    memcpy(copy, set, 32);
+    fold_set(p, copy);
+    copy['\n' >> 3] &= (uint8_t)~(1 << ('\n' & 7));
+    return add_node(p, NODE_SET, g->nsets++, 0);
+}
+
+static int add_byte(parser_t *p, unsigned char c) {
+    uint8_t set[32] = {0};
+    set_add(set, c);
+    return add_set(p, set);
+}
+
+/**
+ * @brief Adds all bytes for which `is(c)` holds, or all others if `negate` is set.
+ */
+static void add_ctype(uint8_t *set, int (*is)(int), bool negate, bool underscore) {
+    int c = 0;
+    for (; c < 256; c++) {
+        bool in = is(c) || (underscore && c == '_');
+        if (in != negate) set_add(set, (unsigned char)c);
+    }
+}
+
+static const struct {
+    const char *name;
+    int (*is)(int);
+} posix_classes[] = {
+    { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank }, { "cntrl", iscntrl },
+    { "digit", isdigit }, { "graph", isgraph }, { "lower", islower }, { "print", isprint },
+    { "punct", ispunct }, { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+};
+
+/**
+ * @brief Parses a bracket expression; `p->s` points behind the `[`.
+ */
+static int parse_class(parser_t *p) {
+    uint8_t set[32] = {0};
+    bool negate = false, first = true;
+    int i;
+
+    if (*p->s == '^') {
+        negate = true;
+        p->s++;
+    }
+    while (first || *p->s != ']') {
+        unsigned char lo;
+        first = false;
+        if (*p->s == '\0') {
+            p->error = "unmatched [";
+            return -1;
+        }
+        if (p->s[0] == '[' && p->s[1] == ':') {
+            const char *name = (const char *)p->s + 2;
+            const char *close = strstr(name, ":]");
+            bool found = false;
+            for (i = 0; close != NULL && i < (int)(sizeof(posix_classes) / sizeof(posix_classes[0])); i++) {
+                if ((size_t)(close - name) == strlen(posix_classes[i].name) &&
+                    strncmp(name, posix_classes[i].name, close - name) == 0) {
+                    add_ctype(set, posix_classes[i].is, false, false);
+                    found = true;
+                }
+            }
+            if (!found) {
+                p->error = "invalid character class";
+                return -1;
+            }
+            p->s = (const unsigned char *)close + 2;
+            continue;
+        }
+        lo = *p->s++;
+        if (p->s[0] == '-' && p->s[1] != ']' && p->s[1] != '\0') {
+            unsigned char hi = p->s[1];
+            p->s += 2;
+            if (hi < lo) {
+                p->error = "invalid range end";
+                return -1;
+            }
+            for (i = lo; i <= hi; i++) set_add(set, (unsigned char)i);
+        } else {
+            set_add(set, lo);
+        }
+    }
+    p->s++;
+    /* `-i` folds before negating, so [^a-z] excludes upper case letters as well */
+    fold_set(p, set);
+    if (negate) {
+        for (i = 0; i < 32; i++) set[i] = (uint8_t)~set[i];
+    }
+    return add_set(p, set);
+}
+
+/**
+ * @brief Parses a backslash escape; `p->s` points behind the backslash.
+ *
+ * @details Only the classes and the special characters can be escaped. Other escapes, e.g.
+ * `\b` or `\<`, mean something else in other grep implementations, so they are rejected
+ * instead of being taken as the plain character.
+ */
+static int parse_escape(parser_t *p) {
+    uint8_t set[32] = {0};
+    unsigned char c = *p->s;
+
+    if (c == '\0') {
+        p->error = "trailing backslash";
+        return -1;
+    }
+    switch (c) {
+        case 'w': case 'W': add_ctype(set, isalnum, c == 'W', true); break;
+        case 'd': case 'D': add_ctype(set, isdigit, c == 'D', false); break;
+        case 's': case 'S': add_ctype(set, isspace, c == 'S', false); break;
+        default:
+            if (strchr(".[]()*+?{}|^$\\", c) == NULL) {
+                p->error = "unsupported escape sequence";
+                return -1;
+            }
+            p->s++;
+            return add_byte(p, c);
+    }
+    p->s++;
+    return add_set(p, set);
+}
+
+static int parse_alt(parser_t *p);
+
+/**
+ * @brief Checks whether `s` starts an interval `{m}`, `{m,}`, `{,n}` or `{m,n}`. Anything
+ * else starting with `{` is a literal brace.
+ */
+static bool is_interval(const unsigned char *s) {
+    if (*s++ != '{') return false;
+    while (isdigit(*s)) s++;
+    if (*s == ',') s++;
+    while (isdigit(*s)) s++;
+    return *s == '}' && s[-1] != '{';
+}
+
+static bool is_repeat(const unsigned char *s) {
+    return *s == '*' || *s == '+' || *s == '?' || is_interval(s);
+}
+
+/**
+ * @brief Parses one atom. A repetition operator without an operand repeats the empty
+ * string, as in GNU grep.
+ */
+static int parse_atom(parser_t *p) {
+    uint8_t set[32];
+    int a;
+
+    if (is_repeat(p->s)) return add_node(p, NODE_EMPTY, 0, 0);
+    switch (*p->s) {
+        case '(':
+            if (++p->depth > MAX_DEPTH) {
+                p->error = "parentheses nested too deeply";
+                return -1;
+            }
+            p->s++;
+            a = parse_alt(p);
+            if (p->error != NULL) return -1;
+            if (*p->s != ')') {
+                p->error = "unmatched (";
+                return -1;
+            }
+            p->s++;
+            p->depth--;
+            return a;
+        case '[':
+            p->s++;
+            return parse_class(p);
+        case '.':
+            p->s++;
+            memset(set, 0xff, sizeof(set));
+            return add_set(p, set);
+        case '^':
+            p->s++;
+            return add_node(p, NODE_BOL, 0, 0);
+        case '$':
+            p->s++;
+            return add_node(p, NODE_EOL, 0, 0);
+        case '\\':
+            p->s++;
+            return parse_escape(p);
+        default:
+            return add_byte(p, *p->s++);
+    }
+}
+
+/**
+ * @brief Parses the digits of an interval bound.
+ */
+static int parse_bound(parser_t *p) {
+    int n = 0;
+    while (isdigit(*p->s)) {
+        n = n * 10 + (*p->s++ - '0');
+        if (n > MAX_REPEAT) {
+            p->error = "interval bound too large";
+            return -1;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Parses an atom followed by any number of `*`, `+`, `?` and intervals.
+ */
+static int parse_repeat(parser_t *p) {
+    int a = parse_atom(p);
+
+    while (p->error == NULL && is_repeat(p->s)) {
+        int min = 0, max = -1;
+        if (*p->s == '+') {
+            min = 1;
+        } else if (*p->s == '?') {
+            max = 1;
+        } else if (*p->s == '{') {
+            p->s++;
+            min = max = parse_bound(p);
+            if (*p->s == ',') {
+                p->s++;
+                max = isdigit(*p->s) ? parse_bound(p) : -1;
+            }
+            if (p->error != NULL) return -1;
+            if (max != -1 && max < min) {
+                p->error = "invalid interval";
+                return -1;
+            }
+        }
+        p->s++;
+        if ((a = add_node(p, NODE_REPEAT, a, 0)) < 0) return -1;
+        p->nodes[a].min = min;
+        p->nodes[a].max = max;
+    }
+    return p->error == NULL ? a : -1;
+}
+
+/**
+ * @brief Parses a sequence of repeats up to `|`, the `)` of the enclosing group or the
+ * end of the pattern. A `)` outside of any group is a literal.
+ */
+static int parse_cat(parser_t *p) {
+    int n = -1;
+
+    while (*p->s != '\0' && *p->s != '|' && !(*p->s == ')' && p->depth > 0)) {
+        int a = parse_repeat(p);
+        if (p->error != NULL) return -1;
+        n = n < 0 ? a : add_node(p, NODE_CAT, n, a);
+        if (n < 0) return -1;
+    }
+    return n < 0 ? add_node(p, NODE_EMPTY, 0, 0) : n;
+}
+
+static int parse_alt(parser_t *p) {
+    int n = parse_cat(p);
+
+    while (p->error == NULL && *p->s == '|') {
+        int b;
+        p->s++;
+        b = parse_cat(p);
+        if (p->error != NULL) return -1;
+        n = add_node(p, NODE_ALT, n, b);
+    }
+    return p->error == NULL ? n : -1;
+}
+
+/**
+ * @brief Collects the operands of a left-deep chain of `type` nodes in order.
+ *
+ * @return Number of operands, `*out` has to be freed; -1 if memory ran out.
+ */
+static int spine(const parser_t *p, int n, int type, int **out) {
+    int count = 1, m = n, i;
+
+    for (; p->nodes[m].type == type; m = p->nodes[m].a) count++;
+    if ((*out = malloc(count * sizeof(**out))) == NULL) return -1;
+    for (i = count - 1; p->nodes[n].type == type; n = p->nodes[n].a) (*out)[i--] = p->nodes[n].b;
+    (*out)[0] = n;
+    return count;
+}
+
+/* ---------------------------------------------------------------- NFA */
+
+static int32_t emit(parser_t *p, int op, int32_t x, int32_t y) {
+    struct regexp_prog *g = p->prog;
+
+    if (g->ninst == MAX_INST) {
+        p->error = "regular expression too large";
+        return 0;
+    }
+    if (g->ninst == g->capinst) {
+        int32_t cap = g->capinst > 0 ? 2 * g->capinst : 64;
+        inst_t *inst = realloc(g->inst, cap * sizeof(*inst));
+        if (inst == NULL) {
+            p->error = "out of memory";
+            return 0;
+        }
+        g->inst = inst;
+        g->capinst = cap;
+    }
+    g->inst[g->ninst] = (inst_t){ .op = op, .x = x, .y = y };
+    return g->ninst++;
+}
+
+/**
+ * @brief Appends the instructions for a syntax tree node.
+ */
+static void compile(parser_t *p, int n) {
+    inst_t *inst;
+    node_t node = p->nodes[n];
+    int *ops, count, i;
+    int32_t *fix;
+
+    switch (node.type) {
+        case NODE_SET:
+            emit(p, OP_SET, node.a, 0);
+            break;
+        case NODE_BOL:
+            emit(p, OP_BOL, 0, 0);
+            break;
+        case NODE_EOL:
+            emit(p, OP_EOL, 0, 0);
+            break;
+        case NODE_EMPTY:
+            break;
+        case NODE_CAT:
+            if ((count = spine(p, n, NODE_CAT, &ops)) < 0) {
+                p->error = "out of memory";
+                break;
+            }
+            for (i = 0; i < count && p->error == NULL; i++) compile(p, ops[i]);
+            free(ops);
+            break;
+        case NODE_ALT:
+            /* split L1, next; L1: alternative; jmp end; next: ... */
+            if ((count = spine(p, n, NODE_ALT, &ops)) < 0 || (fix = malloc(count * sizeof(*fix))) == NULL) {
+                p->error = "out of memory";
+                if (count >= 0) free(ops);
+                break;
+            }
+            for (i = 0; i < count && p->error == NULL; i++) {
+                int32_t split = i < count - 1 ? emit(p, OP_SPLIT, p->prog->ninst + 1, 0) : -1;
+                compile(p, ops[i]);
+                fix[i] = i < count - 1 ? emit(p, OP_JMP, 0, 0) : -1;
+                if (split >= 0 && p->error == NULL) p->prog->inst[split].y = p->prog->ninst;
+            }
+            for (inst = p->prog->inst, i = 0; i < count - 1 && p->error == NULL; i++) inst[fix[i]].x = p->prog->ninst;
+            free(fix);
+            free(ops);
+            break;
+        case NODE_REPEAT:
+            for (i = 0; i < node.min && p->error == NULL; i++) compile(p, node.a);
+            if (node.max == -1) {
+                /* L: split L+1, end; operand; jmp L */
+                int32_t loop = emit(p, OP_SPLIT, p->prog->ninst + 1, 0);
+                compile(p, node.a);
+                emit(p, OP_JMP, loop, 0);
+                if (p->error == NULL) p->prog->inst[loop].y = p->prog->ninst;
+            } else if (node.max > node.min) {
+                /* each optional copy may skip straight to the end */
+                if ((fix = malloc((node.max - node.min) * sizeof(*fix))) == NULL) {
+                    p->error = "out of memory";
+                    break;
+                }
+                for (i = 0; i < node.max - node.min && p->error == NULL; i++) {
+                    fix[i] = emit(p, OP_SPLIT, p->prog->ninst + 1, 0);
+                    compile(p, node.a);
+                }
+                for (count = i, i = 0; i < count && p->error == NULL; i++) p->prog->inst[fix[i]].y = p->prog->ninst;
+                free(fix);
+            }
+            break;
+    }
+}
+
+/* ---------------------------------------------------------------- literals */
+
+static void lits_clear(litset_t *l) {
+    for (; l->n > 0; l->n--) free(l->s[l->n - 1]);
+    l->exact = false;
+}
+
+/**
+ * @brief Adds a literal unless it is already in the set.
+ *
+ * @return false if the set or the literal would become too large, or memory ran out.
+ */
+static bool lits_add(litset_t *l, const char *s, size_t len) {
+    int i = 0;
+
+    if (len > MAX_LIT_LEN) return false;
+    for (; i < l->n; i++) {
+        if (strlen(l->s[i]) == len && memcmp(l->s[i], s, len) == 0) return true;
+    }
+    if (l->n == MAX_LITS || (l->s[l->n] = malloc(len + 1)) == NULL) return false;
+    memcpy(l->s[l->n], s, len);
+    l->s[l->n][len] = '\0';
+    l->n++;
+    return true;
+}
+
+/**
+ * @brief Adds all literals of `from` to `to`.
+ */
+static bool lits_union(litset_t *to, const litset_t *from) {
+    int i = 0;
+    bool ok = true;
+
+    for (; i < from->n && ok; i++) ok = lits_add(to, from->s[i], strlen(from->s[i]));
+    return ok;
+}
+
+/**
+ * @brief Replaces `a` by all concatenations of a literal of `a` with one of `b`.
+ *
+ * @return false (leaving `a` unchanged) if the result would be too large.
+ */
+static bool lits_product(litset_t *a, const litset_t *b) {
+    litset_t out = { .n = 0 };
+    char buf[2 * MAX_LIT_LEN];
+    int i, j;
+
+    if ((long)a->n * b->n > MAX_LITS) return false;
+    for (i = 0; i < a->n; i++) {
+        for (j = 0; j < b->n; j++) {
+            size_t la = strlen(a->s[i]), lb = strlen(b->s[j]);
+            memcpy(buf, a->s[i], la);
+            memcpy(buf + la, b->s[j], lb);
+            if (!lits_add(&out, buf, la + lb)) {
+                lits_clear(&out);
+                return false;
+            }
+        }
+    }
+    out.exact = a->exact;
+    lits_clear(a);
+    *a = out;
+    return true;
+}
+
+/**
+ * @brief Length of the shortest literal, i.e. how selective the set is; 0 if useless.
+ */
+static size_t lits_score(const litset_t *l) {
+    size_t min = 0;
+    int i = 0;
+
+    for (; i < l->n; i++) {
+        if (i == 0 || strlen(l->s[i]) < min) min = strlen(l->s[i]);
+    }
+    return min;
+}
+
+/**
+ * @brief Keeps the more selective of `best` and `cand` in `best` and empties `cand`.
+ */
+static void lits_consider(litset_t *best, litset_t *cand) {
+    size_t sb = lits_score(best), sc = lits_score(cand);
+
+    if (sc > sb || (sc == sb && sc > 0 && cand->n < best->n)) {
+        lits_clear(best);
+        *best = *cand;
+        cand->n = 0;
+    }
+    lits_clear(cand);
+}
+
+/**
+ * @brief Computes the literals of a syntax tree node.
+ *
+ * @details Whatever cannot be computed, because a set grows too large or memory runs out,
+ * leaves the set empty and not exact, i.e. nothing is known about the matches.
+ */
+static void extract(const parser_t *p, int n, litset_t *out) {
+    node_t node = p->nodes[n];
+    litset_t e = { .n = 0 };
+    int *ops, count, i;
+    int c;
+
+    out->n = 0;
+    out->exact = false;
+    switch (node.type) {
+        case NODE_SET: {
+            const uint8_t *set = p->prog->sets[node.a];
+            int members = 0;
+            bool ok = true;
+            for (c = 0; c < 256; c++) {
+                if (in_set(set, c) && !(p->nocase && isupper(c))) members++;
+            }
+            if (members > MAX_CLASS_LITS || in_set(set, '\0')) break;
+            for (c = 0; c < 256 && ok; c++) {
+                char b = (char)c;
+                if (in_set(set, c) && !(p->nocase && isupper(c))) ok = lits_add(out, &b, 1);
+            }
+            if (ok) out->exact = true;
+            else lits_clear(out);
+            break;
+        }
+        case NODE_EMPTY:
+            out->exact = lits_add(out, "", 0);
+            break;
+        case NODE_BOL:
+        case NODE_EOL:
+            break;
+        case NODE_CAT: {
+            /* runs of exact operands are multiplied out, the best run or operand wins */
+            litset_t best = { .n = 0 };
+            bool exact = true;
+            if ((count = spine(p, n, NODE_CAT, &ops)) < 0) break;
+            out->exact = lits_add(out, "", 0);
+            for (i = 0; i < count; i++) {
+                extract(p, ops[i], &e);
+                if (e.exact && lits_product(out, &e)) {
+                    lits_clear(&e);
+                    continue;
+                }
+                exact = false;
+                lits_consider(&best, out);
+                if (e.exact) {
+                    *out = e;
+                } else {
+                    lits_consider(&best, &e);
+                    out->exact = lits_add(out, "", 0);
+                }
+            }
+            free(ops);
+            if (exact) {
+                lits_clear(&best);
+            } else {
+                lits_consider(&best, out);
+                *out = best;
+                out->exact = false;
+            }
+            break;
+        }
+        case NODE_ALT: {
+            /* every alternative has to contribute a literal */
+            bool exact = true, ok = true;
+            if ((count = spine(p, n, NODE_ALT, &ops)) < 0) break;
+            for (i = 0; i < count && ok; i++) {
+                extract(p, ops[i], &e);
+                exact = exact && e.exact;
+                ok = (e.exact || e.n > 0) && lits_union(out, &e);
+                lits_clear(&e);
+            }
+            free(ops);
+            if (ok) out->exact = exact;
+            else lits_clear(out);
+            break;
+        }
+        case NODE_REPEAT:
+            extract(p, node.a, &e);
+            if (e.exact && node.max != -1) {
+                /* a bounded repeat of an exact operand is the union of its powers */
+                litset_t power = { .n = 0 };
+                bool ok = lits_add(&power, "", 0);
+                for (i = 0; i <= node.max && ok; i++) {
+                    if (i >= node.min) ok = lits_union(out, &power);
+                    if (i < node.max) ok = ok && lits_product(&power, &e);
+                }
+                lits_clear(&power);
+                if (ok) {
+                    out->exact = true;
+                    lits_clear(&e);
+                    break;
+                }
+                lits_clear(out);
+            }
+            /* otherwise only the operand itself is known to occur */
+            if (node.min > 0) {
+                *out = e;
+                out->exact = false;
+            } else {
+                lits_clear(&e);
+            }
+            break;
+    }
+}
+
+/* ---------------------------------------------------------------- DFA */
+
+/**
+ * @brief Allocates the work space for computing state sets of `g`.
+ *
+ * @return false if memory ran out; `work_free()` has to be called either way.
+ */
+static bool work_init(work_t *w, const struct regexp_prog *g) {
+    w->stack = malloc((3 * (size_t)g->ninst + 2) * sizeof(*w->stack));
+    w->next = malloc(((size_t)g->ninst + 1) * sizeof(*w->next));
+    w->mark = calloc(g->ninst, sizeof(*w->mark));
+    w->gen = 0;
+    w->visited = 0;
+    return w->stack != NULL && w->next != NULL && w->mark != NULL;
+}
+
+static void work_free(work_t *w) {
+    free(w->stack);
+    free(w->next);
+    free(w->mark);
+}
+
+/**
+ * @brief Follows all jumps, splits and satisfied anchors from the instructions in `in`.
+ *
+ * @param bol Whether `^` holds, i.e. nothing of the line was consumed yet.
+ * @param eol Whether `$` holds; otherwise `OP_EOL` stays in the result.
+ * @param out Receives the `OP_SET`, `OP_EOL` and `OP_MATCH` instructions reached.
+ * @return Number of instructions in `out`.
+ */
+static int32_t closure(const struct regexp_prog *g, work_t *w, const int32_t *in, int32_t n,
+                       bool bol, bool eol, int32_t *out) {
+    uint32_t gen = ++w->gen;
+    int32_t top = 0, nout = 0;
+
+    if (gen == 0) {
+        memset(w->mark, 0, g->ninst * sizeof(*w->mark));
+        gen = w->gen = 1;
+    }
+    while (n > 0) w->stack[top++] = in[--n];
+    while (top > 0) {
+        int32_t pc = w->stack[--top];
+        const inst_t *i = &g->inst[pc];
+        if (w->mark[pc] == gen) continue;
+        w->mark[pc] = gen;
+        w->visited++;
+        switch (i->op) {
+            case OP_SPLIT:
+                w->stack[top++] = i->y;
+                w->stack[top++] = i->x;
+                break;
+            case OP_JMP:
+                w->stack[top++] = i->x;
+                break;
+            case OP_BOL:
+                if (bol) w->stack[top++] = pc + 1;
+                break;
+            case OP_EOL:
+                if (eol) w->stack[top++] = pc + 1;
+                else out[nout++] = pc;
+                break;
+            default:
+                out[nout++] = pc;
+        }
+    }
+    return nout;
+}
+
+static bool has_match(const struct regexp_prog *g, const int32_t *set, int32_t n) {
+    while (n > 0) {
+        if (set[--n] == g->ninst - 1) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Computes the state after consuming byte `c` in the middle of a line.
+ */
+static int32_t step(const struct regexp_prog *g, work_t *w, const int32_t *set, int32_t n,
+                    unsigned char c, int32_t *out) {
+    int32_t m = 0, i = 0;
+
+    for (; i < n; i++) {
+        const inst_t *in = &g->inst[set[i]];
+        if (in->op == OP_SET && in_set(g->sets[in->x], c)) w->next[m++] = set[i] + 1;
+    }
+    w->next[m++] = 0;
+    return closure(g, w, w->next, m, false, false, out);
+}
+
+/**
+ * @brief Checks whether the line is matched if it ends in the given state.
+ */
+static bool eol_accepts(const struct regexp_prog *g, work_t *w, const int32_t *set, int32_t n,
+                        bool bol, int32_t *scratch) {
+    return has_match(g, scratch, closure(g, w, set, n, bol, true, scratch));
+}
+
+/**
+ * @brief Splits the bytes into classes that no byte set distinguishes; `\n` gets its own.
+ *
+ * @return Number of classes, `rep` receives one byte of every class.
+ */
+static int32_t build_classes(const struct regexp_prog *g, uint8_t *classes, unsigned char *rep) {
+    int32_t n = 2, i, c;
+
+    memset(classes, 0, 256);
+    classes['\n'] = 1;
+    for (i = 0; i < g->nsets; i++) {
+        int16_t remap[512];
+        int32_t next = 0;
+        for (c = 0; c < 512; c++) remap[c] = -1;
+        for (c = 0; c < 256; c++) {
+            int key = classes[c] * 2 + in_set(g->sets[i], (unsigned char)c);
+            if (remap[key] < 0) remap[key] = (int16_t)next++;
+            classes[c] = (uint8_t)remap[key];
+        }
+        n = next;
+    }
+    for (c = 255; c >= 0; c--) rep[classes[c]] = (unsigned char)c;
+    return n;
+}
+
+static int cmp_pc(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @struct states
+ * @brief DFA states under construction: their instruction sets and a hash index.
+ */
+typedef struct states {
+    int32_t *pool;
+    size_t npool, cappool;
+    size_t *off;
+    int32_t *len;
+    int32_t count;
+    int32_t hash[2 * MAX_STATES];
+} states_t;
+
+/**
+ * @brief Returns the number of the state with instruction set `set`, adding it if new.
+ *
+ * @return State number, or -1 if the DFA already has `MAX_STATES` states or memory ran out.
+ */
+static int32_t intern(states_t *st, int32_t *set, int32_t n) {
+    uint32_t h = 2166136261u;
+    int32_t i, slot;
+
+    qsort(set, n, sizeof(*set), cmp_pc);
+    for (i = 0; i < n; i++) h = (h ^ (uint32_t)set[i]) * 16777619u;
+    for (slot = h & (2 * MAX_STATES - 1); st->hash[slot] >= 0; slot = (slot + 1) & (2 * MAX_STATES - 1)) {
+        int32_t id = st->hash[slot];
+        if (st->len[id] == n && memcmp(st->pool + st->off[id], set, n * sizeof(*set)) == 0) return id;
+    }
+    if (st->count == MAX_STATES) return -1;
+    if (st->npool + n > st->cappool) {
+        size_t cap = 2 * (st->npool + n);
+        int32_t *pool = realloc(st->pool, cap * sizeof(*pool));
+        if (pool == NULL) return -1;
+        st->pool = pool;
+        st->cappool = cap;
+    }
+    memcpy(st->pool + st->npool, set, n * sizeof(*set));
+    st->off[st->count] = st->npool;
+    st->len[st->count] = n;
+    st->npool += n;
+    st->hash[slot] = st->count;
+    return st->count++;
+}
+
+/**
+ * @brief Builds the complete DFA by breadth-first subset construction.
+ *
+ * @return false if it grew beyond `MAX_STATES` states or `MAX_WORK`, or memory ran out;
+ * `table` is NULL then.
+ */
+static bool build_dfa(regexp_t *re) {
+    const struct regexp_prog *g = re->prog;
+    unsigned char rep[256];
+    states_t *st = calloc(1, sizeof(*st));
+    int32_t *set, *scratch, zero = 0, n, s, c;
+    size_t cap = 0;
+    work_t w;
+    bool ok;
+
+    if (st == NULL) return false;
+    ok = work_init(&w, g);
+    set = malloc(((size_t)g->ninst + 1) * sizeof(*set));
+    scratch = malloc(((size_t)g->ninst + 1) * sizeof(*scratch));
+    st->off = malloc(MAX_STATES * sizeof(*st->off));
+    st->len = malloc(MAX_STATES * sizeof(*st->len));
+    if (set == NULL || scratch == NULL || st->off == NULL || st->len == NULL) ok = false;
+    for (s = 0; s < 2 * MAX_STATES; s++) st->hash[s] = -1;
+
+    if (ok) {
+        re->nclasses = build_classes(g, re->classes, rep);
+        n = closure(g, &w, &zero, 1, true, false, set);
+        re->always = has_match(g, set, n);
+        ok = intern(st, set, n) >= 0;
+    }
+
+    for (s = 0; s < st->count && ok && !re->always; s++) {
+        if ((size_t)st->count * re->nclasses > cap) {
+            int32_t *table = realloc(re->table, 2 * (size_t)st->count * re->nclasses * sizeof(*table));
+            if (table == NULL) {
+                ok = false;
+                break;
+            }
+            re->table = table;
+            cap = 2 * (size_t)st->count * re->nclasses;
+        }
+        for (c = 0; c < re->nclasses && ok; c++) {
+            int32_t *cur = st->pool + st->off[s], id;
+            /* `cur` points into the pool, copy it before `intern()` may move the pool */
+            memcpy(scratch, cur, st->len[s] * sizeof(*cur));
+            if (rep[c] == '\n') {
+                id = eol_accepts(g, &w, scratch, st->len[s], s == 0, set) ? REGEXP_ACCEPT : 0;
+            } else {
+                n = step(g, &w, scratch, st->len[s], rep[c], set);
+                if (has_match(g, set, n)) id = REGEXP_ACCEPT;
+                else if ((id = intern(st, set, n)) < 0) ok = false;
+                else id *= re->nclasses;
+            }
+            re->table[s * re->nclasses + c] = id;
+            if (w.visited > MAX_WORK) ok = false;
+        }
+    }
+    re->nstates = st->count;
+    if (!ok || re->always) {
+        free(re->table);
+        re->table = NULL;
+    }
+
+    work_free(&w);
+    free(scratch);
+    free(set);
+    free(st->pool);
+    free(st->off);
+    free(st->len);
+    free(st);
+    return ok;
+}
+
+/* ---------------------------------------------------------------- matching */
+
+static void scratch_free(scratch_t *s) {
+    if (s == NULL) return;
+    work_free(&s->w);
+    free(s->cur);
+    free(s->next);
+    free(s);
+}
+
+/**
+ * @brief Allocates the memory for simulating the NFA in one search.
+ *
+ * @return The scratch memory, or NULL if memory ran out.
+ */
+static scratch_t *scratch_new(const struct regexp_prog *g) {
+    scratch_t *s = calloc(1, sizeof(*s));
+
+    if (s == NULL) return NULL;
+    s->cur = malloc(((size_t)g->ninst + 1) * sizeof(*s->cur));
+    s->next = malloc(((size_t)g->ninst + 1) * sizeof(*s->next));
+    if (!work_init(&s->w, g) || s->cur == NULL || s->next == NULL) {
+        scratch_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+/**
+ * @brief Takes the scratch memory of the NFA if no other search uses it, otherwise
+ * allocates a private one; without memory for that, waits for the shared one.
+ */
+static scratch_t *scratch_take(struct regexp_prog *g) {
+    scratch_t *s;
+
+    for (;;) {
+        if (!__atomic_exchange_n(&g->busy, true, __ATOMIC_ACQUIRE)) return g->spare;
+        if ((s = scratch_new(g)) != NULL) return s;
+        sched_yield();
+    }
+}
+
+/**
+ * @brief Hands back scratch memory taken with `scratch_take()`.
+ */
+static void scratch_give(struct regexp_prog *g, scratch_t *s) {
+    if (s == g->spare) __atomic_store_n(&g->busy, false, __ATOMIC_RELEASE);
+    else scratch_free(s);
+}
+
+/**
+ * @brief Runs the DFA over the non-empty lines [p, end) until a line is accepted.
+ */
+static const char *dfa_scan(const regexp_t *re, const char *p, const char *end) {
+    const unsigned char *u = (const unsigned char *)p;
+    const unsigned char *uend = (const unsigned char *)end;
+    const int32_t *table = re->table;
+    int32_t state = 0;
+
+    for (; u < uend; u++) {
+        int32_t next = table[state + re->classes[*u]];
+        if (next < 0) return (const char *)u;
+        state = next;
+    }
+    if (end[-1] != '\n' && table[state + re->classes['\n']] < 0) return end - 1;
+    return NULL;
+}
+
+/**
+ * @brief Simulates the NFA over the non-empty lines [p, end), for patterns whose DFA is
+ * too large. Costs O(NFA size) per byte, but never backtracks either.
+ */
+static const char *nfa_scan(const regexp_t *re, work_t *w, int32_t *cur, int32_t *next,
+                            const char *p, const char *end) {
+    const struct regexp_prog *g = re->prog;
+    int32_t zero = 0, n = closure(g, w, &zero, 1, true, false, cur);
+    bool bol = true;
+
+    for (; p < end; p++) {
+        if (*p == '\n') {
+            if (eol_accepts(g, w, cur, n, bol, next)) return p;
+            n = closure(g, w, &zero, 1, true, false, cur);
+            bol = true;
+        } else {
+            int32_t *t = cur;
+            n = step(g, w, cur, n, (unsigned char)*p, next);
+            if (has_match(g, next, n)) return p;
+            cur = next;
+            next = t;
+            bol = false;
+        }
+    }
+    if (end[-1] != '\n' && eol_accepts(g, w, cur, n, bol, next)) return end - 1;
+    return NULL;
+}
+
+static void prog_free(struct regexp_prog *g) {
+    if (g == NULL) return;
+    scratch_free(g->spare);
+    free(g->inst);
+    free(g->sets);
+    free(g);
+}
+
+/**
+ * @brief Parses all patterns into one alternation, extracts the prefilter literals and
+ * builds the DFA unless the literals alone decide.
+ */
+const char *regexp_compile(regexp_t *re, char *const patterns[], int count, bool nocase) {
+    parser_t p = { .nocase = nocase };
+    litset_t lits = { .n = 0 };
+    const char *error = NULL;
+    int root = -1, i = 0;
+
+    memset(re, 0, sizeof(*re));
+    if (count == 0) {
+        re->never = true;
+        return NULL;
+    }
+    if ((p.prog = calloc(1, sizeof(*p.prog))) == NULL) return "out of memory";
+    for (; i < count && p.error == NULL; i++) {
+        int n;
+        p.s = (const unsigned char *)patterns[i];
+        p.depth = 0;
+        n = parse_alt(&p);
+        if (p.error == NULL) root = root < 0 ? n : add_node(&p, NODE_ALT, root, n);
+    }
+    if (p.error == NULL) {
+        compile(&p, root);
+        emit(&p, OP_MATCH, 0, 0);
+    }
+    if (p.error != NULL) {
+        prog_free(p.prog);
+        free(p.nodes);
+        return p.error;
+    }
+
+    extract(&p, root, &lits);
+    free(p.nodes);
+    re->prog = p.prog;
+    if (lits_score(&lits) > 0) {
+        if ((re->literals = malloc(lits.n * sizeof(*re->literals))) == NULL) error = "out of memory";
+        else if (lits.n == 1) error = search_compile(&re->lit, lits.s[0], strlen(lits.s[0]), nocase);
+        else error = ac_compile(&re->lits, lits.s, lits.n, nocase);
+        if (error != NULL) {
+            lits_clear(&lits);
+            regexp_free(re);
+            return error;
+        }
+        re->nlits = lits.n;
+        re->exact = lits.exact;
+        memcpy(re->literals, lits.s, lits.n * sizeof(*re->literals));
+        lits.n = 0;
+    }
+    lits_clear(&lits);
+
+    /* the NFA is kept if there is no DFA, with memory for one search */
+    if (re->exact || build_dfa(re)) {
+        prog_free(re->prog);
+        re->prog = NULL;
+    } else if ((re->prog->spare = scratch_new(re->prog)) == NULL) {
+        regexp_free(re);
+        return "out of memory";
+    }
+    return NULL;
+}
+
+/**
+ * @brief Searches the prefilter literals first and runs the automaton only on the lines
+ * that contain one; without literals the automaton scans everything.
+ */
+const char *regexp_find(const regexp_t *re, const char *hay, size_t len) {
+    const char *p = hay;
+    const char *end = hay + len;
+    const char *hit = NULL;
+    scratch_t *s = NULL;
+
+    if (re->never || len == 0) return NULL;
+    if (re->always) return hay;
+    if (re->prog != NULL) s = scratch_take(re->prog);
+
+    while (p < end) {
+        const char *line = p;
+        const char *eol = end;
+        if (re->nlits > 0) {
+            const char *lit = re->nlits == 1 ? search_find(&re->lit, p, end - p) : ac_find(&re->lits, p, end - p);
+            if (lit == NULL || re->exact) {
+                hit = lit;
+                break;
+            }
+            line = lit;
+            while (line > p && line[-1] != '\n') line--;
+            eol = memchr(lit, '\n', end - lit);
+            eol = eol == NULL ? end : eol + 1;
+        }
+        hit = s != NULL ? nfa_scan(re, &s->w, s->cur, s->next, line, eol) : dfa_scan(re, line, eol);
+        if (hit != NULL) break;
+        p = eol;
+    }
+
+    if (s != NULL) scratch_give(re->prog, s);
+    return hit;
+}
+
+/**
+ * @brief Frees the DFA or NFA and the prefilter.
+ */
+void regexp_free(regexp_t *re) {
+    free(re->table);
+    prog_free(re->prog);
+    if (re->nlits == 1) search_free(&re->lit);
+    else if (re->nlits > 1) ac_free(&re->lits);
+    for (; re->nlits > 0; re->nlits--) free(re->literals[re->nlits - 1]);
+    free(re->literals);
+    re->literals = NULL;
+    re->table = NULL;
+    re->prog = NULL;
+}
@@ -0,0 +1,90 @@
+#ifndef REGEXP_H
+#define REGEXP_H
+/**
+ * @file regexp.h
+ * @brief Extended regular expressions (`-E`) for `mygrep`, matched by a DFA.
+ *
+ * A pattern is parsed into a syntax tree and compiled into a Thompson NFA. Its subset
+ * construction, the DFA, is built completely at compile time, so matching costs one table
+ * load per input byte and can never backtrack. Patterns whose DFA would grow too large are
+ * matched by simulating the NFA instead, which is slower but still linear in the input.
+ *
+ * Literals that every match has to contain are extracted from the syntax tree and searched
+ * with the substring kernel or the Aho-Corasick automaton first; only lines that contain
+ * one of them are run through the DFA. A pattern that is nothing but a set of literals is
+ * matched by that prefilter alone.
+ *
+ * Supported syntax: literals, `.`, bracket expressions with ranges and POSIX classes,
+ * `\w \W \d \D \s \S`, `^`, `$`, `*`, `+`, `?`, `{m}`, `{m,}`, `{m,n}`, `|` and groups.
+ * A backslash before one of `.[]()*+?{}|^$\` makes it literal; any other escape is an
+ * error. Matches never span a newline.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "search.h"
+#include "ahocorasick.h"
+
+/** Transition table entry for "the line matches". */
+#define REGEXP_ACCEPT (-1)
+
+/**
+ * @struct regexp
+ * @brief A compiled set of patterns, a line matches if it matches any of them.
+ *
+ * @details `table` holds `nstates * nclasses` entries, each the premultiplied row offset
+ * of the target state or `REGEXP_ACCEPT`. State 0 is the state at the start of a line,
+ * every newline leads back to it. `table` is NULL if the DFA was too large, `prog` then
+ * holds the NFA that is simulated instead.
+ *
+ * `nlits` is the number of prefilter literals (0 for none), `literals` holds them, one
+ * literal is searched with `lit`, several with `lits`. If `exact` is set, a literal
+ * occurrence is a match.
+ * `always` is set if every line matches, `never` if no line does.
+ */
+typedef struct regexp {
+    int32_t *table;
+    uint8_t classes[256];
+    int32_t nclasses;
+    int32_t nstates;
+    struct regexp_prog *prog;
+    int nlits;
+    char **literals;
+    searcher_t lit;
+    ac_t lits;
+    bool exact;
+    bool always;
+    bool never;
+} regexp_t;
+
+/**
+ * @brief Compiles `count` patterns into one matcher.
+ *
+ * @param re The regexp to initialise.
+ * @param patterns The patterns, NUL-terminated.
+ * @param count Number of patterns; with 0 patterns nothing matches.
+ * @param nocase If true, ASCII letters match regardless of their case.
+ * @return NULL on success, otherwise a message describing the syntax error, a pattern
+ * too large to compile or "out of memory". Nothing has to be freed after an error.
+ */
+const char *regexp_compile(regexp_t *re, char *const patterns[], int count, bool nocase);
+
+/**
+ * @brief Finds the first line in `hay` that contains a match.
+ *
+ * @param re A compiled regexp.
+ * @param hay Start of the bytes to scan, must be the start of a line.
+ * @param len Number of bytes to scan; the last line ends at `hay + len`.
+ * @return Pointer to a byte of the first matching line (at or after the match start, but
+ * not necessarily its first byte), or NULL if no line matches.
+ */
+const char *regexp_find(const regexp_t *re, const char *hay, size_t len);
+
+/**
+ * @brief Releases the memory held by a regexp.
+ */
+void regexp_free(regexp_t *re);
+
+#endif // REGEXP_H
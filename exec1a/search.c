@@ -0,0 +1,296 @@
+/**
+ * @file search.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Substring search kernels for `mygrep`.
+ *
+ * All kernels use the same idea: a position can only start a match if the first and the
+ * last byte of the needle are found at the right distance. The vector kernels test 16
+ * (SSE2) or 32 (AVX2) positions at once with two compares and only call `memcmp()` for
+ * the candidates that survive both filters.
+ *
+ * For case-insensitive searches the needle is folded to lower case once. The filters then
+ * OR 0x20 into the haystack bytes if the filter byte is a letter, which accepts exactly the
+ * two cases of that letter, and candidates are verified with an ASCII case-folding compare
+ * that works in place, without copying the line.
+ */
+
+#include "search.h"
+
+#include <stdio.h>
+#include <ctype.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Compares `n` haystack bytes against the folded needle, ignoring ASCII case.
+ *
+ * @param hay Haystack bytes in any case.
+ * @param folded Needle bytes already folded to lower case.
+ * @param n Number of bytes to compare.
+ * @return true if all bytes are equal after folding.
+ */
+static bool fold_equal(const char *hay, const char *folded, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i below_a = _mm_set1_epi8('A' - 1);
+    const __m128i above_z = _mm_set1_epi8('Z' + 1);
+    const __m128i bit = _mm_set1_epi8(0x20);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(hay + i));
+        /* bytes >= 0x80 are negative as signed chars and never count as upper case */
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(b, below_a), _mm_cmplt_epi8(b, above_z));
+        b = _mm_or_si128(b, _mm_and_si128(upper, bit));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_loadu_si128((const __m128i *)(folded + i)))) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (tolower((unsigned char)hay[i]) != (unsigned char)folded[i]) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Verifies the bytes between the first and the last byte of a candidate.
+ *
+ * @param s Compiled searcher.
+ * @param p Candidate match, its first and last byte already passed the filters.
+ * @return true if `p` starts a match.
+ */
+static inline bool verify(const searcher_t *s, const char *p) {
+    if (s->len <= 2) return true;
+    if (s->nocase) return fold_equal(p + 1, s->needle + 1, s->len - 2);
+    return memcmp(p + 1, s->needle + 1, s->len - 2) == 0;
+}
+
+typedef const char *(*kernel_fn)(const searcher_t *s, const char *hay, size_t n, size_t from);
+
+/**
+ * @brief Scalar kernel, `memchr()` for the first byte followed by verification.
+ *
+ * @details `memchr()` cannot look for two cases at once, case-insensitive searches
+ * test every position with the filter masks instead.
+ *
+ * @param s Compiled searcher, `len >= 2` unless it is case-insensitive.
+ * @param hay Haystack.
+ * @param n Haystack length, at least `s->len`.
+ * @param from Offset to start at.
+ * @return Pointer to the first match, or NULL.
+ */
+static const char *find_scalar(const searcher_t *s, const char *hay, size_t n, size_t from) {
+    const char *p = hay + from;
+    const char *end = hay + n - s->len + 1;
+
+    if (s->nocase) {
+        for (; p < end; p++) {
+            if (((unsigned char)p[0] | s->first_mask) == s->first
+                && ((unsigned char)p[s->len - 1] | s->last_mask) == s->last && verify(s, p)) {
+                return p;
+            }
+        }
+        return NULL;
+    }
+    while (p < end && (p = memchr(p, s->first, end - p)) != NULL) {
+        if ((unsigned char)p[s->len - 1] == s->last && verify(s, p)) {
+            return p;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+#ifdef SEARCH_X86
+
+/**
+ * @brief SSE2 kernel, filters 16 candidate positions per iteration.
+ */
+__attribute__((target("sse2")))
+static const char *find_sse2(const searcher_t *s, const char *hay, size_t n, size_t from) {
+    const size_t len = s->len;
+    const __m128i first = _mm_set1_epi8((char)s->first);
+    const __m128i last = _mm_set1_epi8((char)s->last);
+    const __m128i first_mask = _mm_set1_epi8((char)s->first_mask);
+    const __m128i last_mask = _mm_set1_epi8((char)s->last_mask);
+    size_t i = from;
+    size_t end = n - len + 1;
+
+    if (end < 16) return find_scalar(s, hay, n, from);
+    while (i < end) {
+        /* the last block overlaps the previous one instead of falling back to scalar code */
+        size_t at = i + 16 <= end ? i : end - 16;
+        __m128i block_first = _mm_or_si128(_mm_loadu_si128((const __m128i *)(hay + at)), first_mask);
+        __m128i block_last = _mm_or_si128(_mm_loadu_si128((const __m128i *)(hay + at + len - 1)), last_mask);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+        mask &= ~0u << (i - at);
+        i = at;
+
+        while (mask != 0) {
+            unsigned int bit = (unsigned int)__builtin_ctz(mask);
+            if (verify(s, hay + i + bit)) {
+                return hay + i + bit;
+            }
+            mask &= mask - 1;
+        }
+        i += 16;
+    }
+    return NULL;
+}
+
+/**
+ * @brief AVX2 kernel, filters 32 candidate positions per iteration.
+ */
+__attribute__((target("avx2")))
+static const char *find_avx2(const searcher_t *s, const char *hay, size_t n, size_t from) {
+    const size_t len = s->len;
+    const __m256i first = _mm256_set1_epi8((char)s->first);
+    const __m256i last = _mm256_set1_epi8((char)s->last);
+    const __m256i first_mask = _mm256_set1_epi8((char)s->first_mask);
+    const __m256i last_mask = _mm256_set1_epi8((char)s->last_mask);
+    size_t i = from;
+    size_t end = n - len + 1;
+
+    if (end < 32) return find_sse2(s, hay, n, from);
+    /* two blocks per iteration keep both load ports busy on long lines */
+    for (; i + 64 <= end; i += 64) {
+        __m256i eq_lo = _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_or_si256(_mm256_loadu_si256((const __m256i *)(hay + i)), first_mask), first),
+            _mm256_cmpeq_epi8(_mm256_or_si256(_mm256_loadu_si256((const __m256i *)(hay + i + len - 1)), last_mask), last));
+        __m256i eq_hi = _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_or_si256(_mm256_loadu_si256((const __m256i *)(hay + i + 32)), first_mask), first),
+            _mm256_cmpeq_epi8(_mm256_or_si256(_mm256_loadu_si256((const __m256i *)(hay + i + 32 + len - 1)), last_mask), last));
+        unsigned long long mask;
+
+        if (_mm256_testz_si256(_mm256_or_si256(eq_lo, eq_hi), _mm256_or_si256(eq_lo, eq_hi))) continue;
+        mask = (unsigned int)_mm256_movemask_epi8(eq_lo)
+             | (unsigned long long)(unsigned int)_mm256_movemask_epi8(eq_hi) << 32;
+        while (mask != 0) {
+            unsigned int bit = (unsigned int)__builtin_ctzll(mask);
+            if (verify(s, hay + i + bit)) {
+                return hay + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    while (i < end) {
+        /* the last block overlaps the previous one instead of falling back to scalar code */
+        size_t at = i + 32 <= end ? i : end - 32;
+        __m256i block_first = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(hay + at)), first_mask);
+        __m256i block_last = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(hay + at + len - 1)), last_mask);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+        mask &= ~0u << (i - at);
+        i = at;
+
+        while (mask != 0) {
+            unsigned int bit = (unsigned int)__builtin_ctz(mask);
+            if (verify(s, hay + i + bit)) {
+                return hay + i + bit;
+            }
+            mask &= mask - 1;
+        }
+        i += 32;
+    }
+    return NULL;
+}
+
+static const kernel_fn kernels[] = { find_scalar, find_sse2, find_avx2 };
+
+#else
+
+static const kernel_fn kernels[] = { find_scalar };
+
+#endif
+
+/**
+ * @brief Checks whether the running CPU can execute `kernel`.
+ */
+static bool kernel_supported(search_kernel_t kernel) {
+    switch (kernel) {
+    case SEARCH_SCALAR:
+        return true;
+#ifdef SEARCH_X86
+    case SEARCH_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case SEARCH_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Copies (and for `nocase` folds) the needle, records its filter bytes and picks
+ * the widest supported kernel.
+ */
+const char *search_compile(searcher_t *s, const char *needle, size_t len, bool nocase) {
+    size_t i = 0;
+
+    s->needle = malloc(len + 1);
+    if (s->needle == NULL) return "out of memory";
+    for (; i < len; i++) {
+        s->needle[i] = nocase ? (char)tolower((unsigned char)needle[i]) : needle[i];
+    }
+    s->needle[len] = '\0';
+    s->len = len;
+    s->nocase = nocase;
+    s->first = len > 0 ? (unsigned char)s->needle[0] : 0;
+    s->last = len > 0 ? (unsigned char)s->needle[len - 1] : 0;
+    s->first_mask = (nocase && islower(s->first)) ? 0x20 : 0;
+    s->last_mask = (nocase && islower(s->last)) ? 0x20 : 0;
+
+    if (kernel_supported(SEARCH_AVX2)) s->kernel = SEARCH_AVX2;
+    else if (kernel_supported(SEARCH_SSE2)) s->kernel = SEARCH_SSE2;
+    else s->kernel = SEARCH_SCALAR;
+    return NULL;
+}
+
+/**
+ * @brief Overrides the kernel chosen by `search_compile()` if the CPU supports it.
+ */
+bool search_set_kernel(searcher_t *s, search_kernel_t kernel) {
+    if (!kernel_supported(kernel)) return false;
+    s->kernel = kernel;
+    return true;
+}
+
+/**
+ * @brief Maps a kernel to its printable name.
+ */
+const char *search_kernel_name(search_kernel_t kernel) {
+    switch (kernel) {
+    case SEARCH_SSE2: return "sse2";
+    case SEARCH_AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+/**
+ * @brief Dispatches to the selected kernel; empty needles and single case-sensitive bytes
+ * need no filtering.
+ */
+const char *search_find(const searcher_t *s, const char *hay, size_t len) {
+    if (s->len == 0) return hay;
+    if (len < s->len) return NULL;
+    if (s->len == 1 && !s->nocase) return memchr(hay, s->first, len);
+    return kernels[s->kernel](s, hay, len, 0);
+}
+
+/**
+ * @brief Frees the needle copy.
+ */
+void search_free(searcher_t *s) {
+    free(s->needle);
+    s->needle = NULL;
+    s->len = 0;
+}
@@ -0,0 +1,88 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+/**
+ * @file search.h
+ * @brief Substring search kernel used by `mygrep`.
+ *
+ * The needle is preprocessed once by `search_compile()`; `search_find()` then scans
+ * arbitrary byte ranges (not only NUL-terminated strings). On x86 an SSE2 or AVX2
+ * kernel is picked at runtime, every other platform uses the scalar kernel.
+ * Case-insensitive searches fold the needle once and compare against the haystack in
+ * place, so searching never allocates memory.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * @enum SEARCH_KERNEL
+ * @brief Implementation used by `search_find()`.
+ */
+typedef enum SEARCH_KERNEL {
+    SEARCH_SCALAR = 0,
+    SEARCH_SSE2 = 1,
+    SEARCH_AVX2 = 2
+} search_kernel_t;
+
+/**
+ * @struct searcher
+ * @brief A preprocessed needle.
+ *
+ * @details `first` and `last` are the bytes the vector kernels filter on before a
+ * candidate position is verified. For case-insensitive searches `needle` holds the
+ * lower-case form and `first_mask`/`last_mask` are 0x20 for letters, haystack bytes are
+ * ORed with the mask before they are compared against the filter byte.
+ */
+typedef struct searcher {
+    char *needle;
+    size_t len;
+    bool nocase;
+    unsigned char first;
+    unsigned char last;
+    unsigned char first_mask;
+    unsigned char last_mask;
+    search_kernel_t kernel;
+} searcher_t;
+
+/**
+ * @brief Preprocesses a needle and selects the fastest kernel for this CPU.
+ *
+ * @param s The searcher to initialise.
+ * @param needle The bytes to search for (copied).
+ * @param len Length of the needle.
+ * @param nocase If true, ASCII letters match regardless of their case.
+ * @return NULL on success, otherwise "out of memory"; nothing has to be freed then.
+ */
+const char *search_compile(searcher_t *s, const char *needle, size_t len, bool nocase);
+
+/**
+ * @brief Forces a specific kernel, e.g. for benchmarking.
+ *
+ * @param s A compiled searcher.
+ * @param kernel The kernel to use.
+ * @return false if the CPU does not support `kernel`, the searcher is left unchanged then.
+ */
+bool search_set_kernel(searcher_t *s, search_kernel_t kernel);
+
+/**
+ * @brief Returns the name of a kernel ("scalar", "sse2", "avx2").
+ */
+const char *search_kernel_name(search_kernel_t kernel);
+
+/**
+ * @brief Finds the first occurrence of the needle in `hay`.
+ *
+ * @param s A compiled searcher.
+ * @param hay Start of the bytes to scan.
+ * @param len Number of bytes to scan.
+ * @return Pointer to the first match, or NULL if there is none.
+ */
+const char *search_find(const searcher_t *s, const char *hay, size_t len);
+
+/**
+ * @brief Releases the memory held by a searcher.
+ */
+void search_free(searcher_t *s);
+
+#endif // SEARCH_H
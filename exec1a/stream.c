@@ -0,0 +1,216 @@
+/**
+ * @file stream.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Block-based streaming search for input that cannot be memory-mapped.
+ *
+ * The buffer always starts at the beginning of a line (or inside a long line whose start
+ * was spilled). After every `read()` the complete lines in the buffer are handed to
+ * `searchBuffer()` in one call and the incomplete last line is moved to the front.
+ *
+ * A line that fills the whole buffer is handled without growing it: if it already
+ * contains a match, it is written and the rest of the line is copied through to the
+ * output. Otherwise all but the last `maxlen - 1` bytes are written to a temporary spill
+ * file; the kept bytes make sure that a match crossing the spill boundary is still seen.
+ * When the line ends, the spill file is copied to the output if the line matched. With
+ * `-c` and `-l` the start of a long line is simply dropped, only the match counts.
+ * A regular expression match has no length bound, so for `-E` the buffer is grown until
+ * the long line fits instead.
+ */
+
+#include "stream.h"
+
+/**
+ * @struct stream
+ * @brief State of one streaming search.
+ *
+ * @details `inLong` is set while the buffer starts in the middle of a line whose start was
+ * spilled or dropped, `rest` while the remainder of an already matching line is skipped
+ * (and copied in line mode).
+ */
+typedef struct stream {
+    search_t* search;
+    bool lines;
+    FILE* spill;
+    bool inLong;
+    bool rest;
+    bool done;
+    size_t keep;
+} stream_t;
+
+
+/**
+ * @brief Appends the start of the current long line to the spill file.
+ */
+static void spillWrite(stream_t* st, const char* data, size_t len){
+    if(st->spill==NULL && (st->spill=tmpfile())==NULL){
+        perror("error in creating spill file");
+        exit(EXIT_FAILURE);
+    }
+    if(fwrite(data, len, 1, st->spill)!=1){
+        perror("error in writing spill file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/**
+ * @brief Ends the current long line, copying its spilled start to the output if it matched.
+ */
+static void longEnd(stream_t* st, bool matched){
+    char block[BUFSIZ];
+    size_t n;
+
+    if(st->spill!=NULL){
+        if(matched){
+            rewind(st->spill);
+            while((n=fread(block, 1, sizeof(block), st->spill))>0) fwrite(block, n, 1, st->search->output);
+        }
+        fclose(st->spill);
+        st->spill=NULL;
+    }
+    st->inLong=false;
+}
+
+
+/**
+ * @brief Processes the buffered bytes and returns how many of them are done with.
+ *
+ * @param st Stream state.
+ * @param buf Buffer, starting at a line start or inside a long line.
+ * @param have Number of valid bytes in `buf`.
+ * @param cap Capacity of `buf`.
+ * @param eof Whether the input is exhausted, the last line then ends at `have`.
+ * @return Number of bytes consumed from the front of `buf`.
+ */
+static size_t consume(stream_t* st, const char* buf, size_t have, size_t cap, bool eof){
+    search_t* s=st->search;
+    const matcher_t* matcher=&s->opts->pattern->matcher;
+    size_t pos=0;
+    const char* eol;
+
+    if(st->rest){
+        eol=memchr(buf, '\n', have);
+        pos= eol==NULL ? have : (size_t)(eol-buf)+1;
+        if(st->lines) fwrite(buf, pos, 1, s->output);
+        if(eol==NULL){
+            if(eof && st->lines) fputc('\n', s->output);
+            return have;
+        }
+        st->rest=false;
+        if(searchDone(s)){
+            st->done=true;
+            return pos;
+        }
+    }
+
+    if(st->inLong){
+        eol=memchr(buf+pos, '\n', have-pos);
+        if(eol!=NULL || eof){
+            size_t len= eol==NULL ? have-pos : (size_t)(eol-buf)+1-pos;
+            bool matched=matcher_find(matcher, buf+pos, len)!=NULL;
+            longEnd(st, matched && st->lines);
+            if(matched){
+                if(st->lines) fwrite(buf+pos, len, 1, s->output);
+                if(st->lines && eol==NULL) fputc('\n', s->output);
+                s->matches++;
+            }
+            pos+=len;
+            if(searchDone(s)){
+                st->done=true;
+                return pos;
+            }
+        }
+    }
+
+    if(!st->inLong){
+        size_t last=have;
+        while(last>pos && buf[last-1]!='\n') last--;
+        if(eof) last=have;
+        if(last>pos){
+            if(searchBuffer(buf+pos, last-pos, s)){
+                st->done=true;
+                return have;
+            }
+            pos=last;
+        }
+    }
+
+    if(pos==0 && have==cap && !eof){
+        /* one line fills the whole buffer */
+        if(matcher->unbounded) return 0;
+        if(matcher_find(matcher, buf, have)!=NULL){
+            longEnd(st, st->lines);
+            if(st->lines) fwrite(buf, have, 1, s->output);
+            s->matches++;
+            st->rest=true;
+            st->done= !st->lines && searchDone(s);
+            return have;
+        }
+        if(st->lines) spillWrite(st, buf, have-st->keep);
+        st->inLong=true;
+        return have-st->keep;
+    }
+    return pos;
+}
+
+
+/**
+ * @brief Searches everything readable from `fd` in blocks of `BLOCK_SIZE` bytes.
+ *
+ * With `skipBinary` nothing is searched before the first `BINARY_SNIFF` bytes are read
+ * and found free of NUL bytes.
+ *
+ * @param fd File descriptor to read from.
+ * @param s Search progress.
+ */
+void searchStream(int fd, search_t* s){
+    stream_t st = { .search=s, .lines= s->opts->mode==OUTPUT_LINES };
+    size_t cap, have=0;
+    char* buf;
+    bool eof=false;
+    bool sniffed=!s->opts->skipBinary;
+
+    st.keep= s->opts->pattern->matcher.maxlen>0 ? s->opts->pattern->matcher.maxlen-1 : 0;
+    st.done=searchDone(s);
+    cap=BLOCK_SIZE+st.keep;
+    buf=malloc(cap);
+    if(buf==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    while(!eof && !st.done){
+        ssize_t n=read(fd, buf+have, cap-have);
+        size_t done;
+
+        if(n==-1){
+            if(errno==EINTR) continue;
+            perror("error in reading input");
+            exit(EXIT_FAILURE);
+        }
+        eof= n==0;
+        have+=n;
+        if(!sniffed){
+            /* as for a mapped file, the input is skipped if its first bytes hold a NUL byte */
+            if(have<BINARY_SNIFF && !eof) continue;
+            sniffed=true;
+            if(memchr(buf, '\0', have<BINARY_SNIFF ? have : BINARY_SNIFF)!=NULL) break;
+        }
+        done=consume(&st, buf, have, cap, eof);
+        memmove(buf, buf+done, have-done);
+        have-=done;
+        if(have==cap){
+            char* grown= cap<=SIZE_MAX/2 ? realloc(buf, 2*cap) : NULL;
+            if(grown==NULL){
+                perror("Memory allocation failed");
+                exit(EXIT_FAILURE);
+            }
+            buf=grown;
+            cap*=2;
+        }
+    }
+    if(st.spill!=NULL) fclose(st.spill);
+    free(buf);
+}
@@ -0,0 +1,33 @@
+#ifndef STREAM_H
+#define STREAM_H
+/**
+ * @file stream.h
+ * @brief Block-based search of stdin and pipes for `mygrep`.
+ *
+ * Input that cannot be memory-mapped is read with `read()` in large blocks. Every block is
+ * searched as a whole with `searchBuffer()`, only the incomplete line at its end is carried
+ * over to the next block. Lines longer than a block are spilled to a temporary file, so
+ * memory stays bounded no matter how long a line is.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "mygrep.h"
+
+/** Size of one read block. */
+#define BLOCK_SIZE (256 * 1024)
+
+/**
+ * @brief Searches everything readable from `fd` and writes the matching lines.
+ *
+ * @details Reading stops as soon as `searchDone()` is true, so `-l` and `-m` do not
+ * drain the rest of a pipe. With `skipBinary` an input whose first `BINARY_SNIFF` bytes
+ * contain a NUL byte is not searched, as for mapped files.
+ *
+ * @param fd File descriptor to read from, e.g. `STDIN_FILENO` or a pipe.
+ * @param s Search progress.
+ */
+void searchStream(int fd, search_t* s);
+
+#endif // STREAM_H
@@ -0,0 +1,337 @@
+/**
+ * @file uring.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief io_uring read-ahead pipeline for long lists of small input files.
+ *
+ * Every file in the window owns a slot with a read buffer. A file starts with an
+ * `OPENAT` and a `STATX` request submitted together; once both are complete a small
+ * regular file gets a `READ` of its whole contents into the slot buffer. The calling
+ * thread waits only for the oldest file, searches its buffer, queues an asynchronous
+ * `CLOSE` and reuses the slot for the file `URING_WINDOW` positions further on.
+ *
+ * Files that turn out to be large, empty by their size or not regular, and files whose
+ * read came back short, are searched from their descriptor with `searchFd()`; files the
+ * ring could not open or look up are handed to `searchFile()`, which reports errors
+ * exactly as the synchronous path does.
+ */
+
+#include "uring.h"
+
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+
+#ifndef SYS_io_uring_setup
+#define SYS_io_uring_setup 425
+#define SYS_io_uring_enter 426
+#endif
+
+/** Submission queue size; at most three requests per slot are in flight. */
+#define RING_ENTRIES (4 * URING_WINDOW)
+
+/** Request kinds, stored in the low bits of `user_data`. */
+#define OP_OPEN 0
+#define OP_STATX 1
+#define OP_READ 2
+#define OP_CLOSE 3
+
+/**
+ * @struct ring
+ * @brief A mapped io_uring instance.
+ *
+ * @details `queued` counts prepared requests not yet passed to the kernel, `inflight` all
+ * requests whose completion has not been reaped yet. The submission queue has `sqEntries`
+ * entries, the kernel advances `sqHead` as it takes them.
+ */
+typedef struct ring {
+    int fd;
+    void* sqMap;
+    size_t sqSize;
+    void* cqMap;
+    size_t cqSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqEntries;
+    unsigned sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+    unsigned queued;
+    unsigned inflight;
+} ring_t;
+
+/**
+ * @struct slot
+ * @brief I/O state of one file in the window.
+ *
+ * @details `pending` counts the requests of the file still in flight, the file is ready
+ * to be searched when it is 0. `failed` is set if the ring could not open or look up the
+ * file, `direct` if it has to be searched from `fd` instead of `buf`.
+ */
+typedef struct slot {
+    int file;
+    int fd;
+    int pending;
+    bool failed;
+    bool direct;
+    struct statx stx;
+    char* buf;
+    size_t len;
+} slot_t;
+
+
+/**
+ * @brief Creates and maps a ring.
+ *
+ * @return false if io_uring is not available.
+ */
+static bool ringSetup(ring_t* r){
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd=syscall(SYS_io_uring_setup, RING_ENTRIES, &p);
+    if(r->fd<0) return false;
+
+    r->sqSize=p.sq_off.array+p.sq_entries*sizeof(unsigned);
+    r->cqSize=p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+    if((p.features & IORING_FEAT_SINGLE_MMAP) && r->cqSize>r->sqSize) r->sqSize=r->cqSize;
+    r->sqesSize=p.sq_entries*sizeof(struct io_uring_sqe);
+
+    r->sqMap=mmap(NULL, r->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if(r->sqMap==MAP_FAILED){
+        close(r->fd);
+        return false;
+    }
+    r->cqMap= (p.features & IORING_FEAT_SINGLE_MMAP) ? r->sqMap
+            : mmap(NULL, r->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes=mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if(r->cqMap==MAP_FAILED || r->sqes==MAP_FAILED){
+        if(r->cqMap!=MAP_FAILED && r->cqMap!=r->sqMap) munmap(r->cqMap, r->cqSize);
+        if(r->sqes!=MAP_FAILED) munmap(r->sqes, r->sqesSize);
+        munmap(r->sqMap, r->sqSize);
+        close(r->fd);
+        return false;
+    }
+
+    r->sqHead=(unsigned*)((char*)r->sqMap+p.sq_off.head);
+    r->sqTail=(unsigned*)((char*)r->sqMap+p.sq_off.tail);
+    r->sqEntries=p.sq_entries;
+    r->sqMask=*(unsigned*)((char*)r->sqMap+p.sq_off.ring_mask);
+    r->sqArray=(unsigned*)((char*)r->sqMap+p.sq_off.array);
+    r->cqHead=(unsigned*)((char*)r->cqMap+p.cq_off.head);
+    r->cqTail=(unsigned*)((char*)r->cqMap+p.cq_off.tail);
+    r->cqMask=*(unsigned*)((char*)r->cqMap+p.cq_off.ring_mask);
+    r->cqes=(struct io_uring_cqe*)((char*)r->cqMap+p.cq_off.cqes);
+    return true;
+}
+
+
+static void ringFree(ring_t* r){
+    munmap(r->sqes, r->sqesSize);
+    if(r->cqMap!=r->sqMap) munmap(r->cqMap, r->cqSize);
+    munmap(r->sqMap, r->sqSize);
+    close(r->fd);
+}
+
+
+/**
+ * @brief Submits the queued requests and waits for `wait` completions.
+ */
+static void ringEnter(ring_t* r, unsigned wait){
+    for(;;){
+        long n=syscall(SYS_io_uring_enter, r->fd, r->queued, wait, wait>0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if(n>=0){
+            r->queued-=n;
+            if(r->queued==0) return;
+        }
+        else if(errno!=EINTR && errno!=EAGAIN && errno!=EBUSY){
+            perror("error in io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+/**
+ * @brief Appends a request to the submission queue; it is passed to the kernel by the
+ * next `ringEnter()`, or right away if the queue is full.
+ *
+ * @return The request, for setting opcode-specific fields.
+ */
+static struct io_uring_sqe* prepare(ring_t* r, int op, int fd, const void* addr, unsigned len, uint64_t off, uint64_t data){
+    unsigned tail=*r->sqTail;
+    unsigned i;
+    struct io_uring_sqe* sqe;
+
+    /* a full queue is passed to the kernel first, which takes all its entries */
+    if(tail-__atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE)==r->sqEntries){
+        ringEnter(r, 0);
+        tail=*r->sqTail;
+    }
+    i=tail & r->sqMask;
+    sqe=&r->sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode=op;
+    sqe->fd=fd;
+    sqe->addr=(uintptr_t)addr;
+    sqe->len=len;
+    sqe->off=off;
+    sqe->user_data=data;
+    r->sqArray[i]=i;
+    __atomic_store_n(r->sqTail, tail+1, __ATOMIC_RELEASE);
+    r->queued++;
+    r->inflight++;
+    return sqe;
+}
+
+
+/**
+ * @brief Opens and looks up a file in the ring.
+ */
+static void startFile(ring_t* r, slot_t* s, int file, const char* path){
+    uint64_t id=(uint64_t)(file%URING_WINDOW)<<2;
+    struct io_uring_sqe* sqe;
+
+    s->file=file;
+    s->fd=-1;
+    s->pending=2;
+    s->failed=false;
+    s->direct=false;
+    s->len=0;
+    sqe=prepare(r, IORING_OP_OPENAT, AT_FDCWD, path, 0, 0, id | OP_OPEN);
+    sqe->open_flags=O_RDONLY;
+    prepare(r, IORING_OP_STATX, AT_FDCWD, path, STATX_TYPE | STATX_SIZE, (uintptr_t)&s->stx, id | OP_STATX);
+}
+
+
+/**
+ * @brief Records one completion and starts the read of a file once it is open and looked up.
+ */
+static void complete(ring_t* r, slot_t* slots, uint64_t data, int res){
+    int op=data&3;
+    slot_t* s;
+
+    r->inflight--;
+    if(op==OP_CLOSE){
+        /* the kernel cannot close asynchronously */
+        if(res==-EINVAL || res==-EOPNOTSUPP) close((int)(data>>2));
+        return;
+    }
+    s=&slots[data>>2];
+    if(op==OP_OPEN){
+        if(res<0) s->failed=true;
+        else s->fd=res;
+    }
+    else if(op==OP_STATX){
+        if(res<0) s->failed=true;
+    }
+    else{
+        /* a failed or short read is repeated from the descriptor, the file may have changed size */
+        if(res<0 || (uint64_t)res<s->stx.stx_size) s->direct=true;
+        else s->len=res;
+    }
+    if(--s->pending>0 || op==OP_READ || s->failed) return;
+
+    /* files reporting size 0 (e.g. in /proc or /sys) may still have contents */
+    if(!S_ISREG(s->stx.stx_mode) || s->stx.stx_size==0 || s->stx.stx_size>URING_BUFFER){
+        s->direct=true;
+    }
+    else{
+        s->pending=1;
+        prepare(r, IORING_OP_READ, s->fd, s->buf, s->stx.stx_size, 0, (data & ~3ULL) | OP_READ);
+    }
+}
+
+
+/**
+ * @brief Handles all completions the kernel has posted.
+ */
+static void reap(ring_t* r, slot_t* slots){
+    unsigned head=*r->cqHead;
+    unsigned tail=__atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+
+    for(; head!=tail; head++){
+        const struct io_uring_cqe* cqe=&r->cqes[head & r->cqMask];
+        complete(r, slots, cqe->user_data, cqe->res);
+    }
+    __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Searches a file whose I/O is complete and queues the close of its descriptor.
+ *
+ * @return false if the file could not be opened.
+ */
+static bool searchSlot(ring_t* r, slot_t* s, const char* path, FILE* output, const options_t* opts){
+    search_t search = { .opts=opts, .output=output };
+
+    if(s->failed){
+        if(s->fd>=0) close(s->fd);
+        return searchFile(path, output, opts);
+    }
+    if(s->direct){
+        searchFd(s->fd, path, output, opts);
+    }
+    else{
+        if(!opts->skipBinary || memchr(s->buf, '\0', s->len<BINARY_SNIFF ? s->len : BINARY_SNIFF)==NULL){
+            searchBuffer(s->buf, s->len, &search);
+        }
+        searchReport(&search, path);
+    }
+    prepare(r, IORING_OP_CLOSE, s->fd, NULL, 0, 0, ((uint64_t)s->fd<<2) | OP_CLOSE);
+    return true;
+}
+
+
+int searchFilesUring(char* const paths[], int count, FILE* output, const options_t* opts){
+    slot_t slots[URING_WINDOW];
+    ring_t r;
+    char* buffers;
+    int next=0, started=0, failed=-1;
+    int i=0;
+
+    if(!ringSetup(&r)) return URING_UNAVAILABLE;
+    buffers=malloc((size_t)URING_WINDOW*URING_BUFFER);
+    if(buffers==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for(; i<URING_WINDOW; i++) slots[i].buf=buffers+(size_t)i*URING_BUFFER;
+
+    for(; started<count && started<URING_WINDOW; started++) startFile(&r, &slots[started], started, paths[started]);
+    while(next<count && failed==-1){
+        ringEnter(&r, slots[next%URING_WINDOW].pending>0 ? 1 : 0);
+        reap(&r, slots);
+        while(next<count && slots[next%URING_WINDOW].pending==0){
+            if(!searchSlot(&r, &slots[next%URING_WINDOW], paths[next], output, opts)){
+                failed=next;
+                break;
+            }
+            next++;
+            if(started<count){
+                startFile(&r, &slots[started%URING_WINDOW], started, paths[started]);
+                started++;
+            }
+        }
+    }
+
+    /* wait for everything still in flight, then close what was opened but not searched */
+    while(r.inflight>0){
+        ringEnter(&r, 1);
+        reap(&r, slots);
+    }
+    for(i=next+(failed!=-1); i<started; i++){
+        if(slots[i%URING_WINDOW].fd>=0) close(slots[i%URING_WINDOW].fd);
+    }
+    free(buffers);
+    ringFree(&r);
+    return failed;
+}
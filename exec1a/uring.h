@@ -0,0 +1,47 @@
+#ifndef URING_H
+#define URING_H
+/**
+ * @file uring.h
+ * @brief Asynchronous opening and reading of many small input files with io_uring.
+ *
+ * For a long list of input files the time of a sequential search goes into the latency
+ * of `open()`, `fstat()`, `read()` and `close()`, not into scanning. This reader keeps the
+ * opens, status lookups and reads of the next `URING_WINDOW` files in flight in one
+ * io_uring instance while the calling thread searches the oldest completed file, so the
+ * output stays in argument order.
+ *
+ * The ring is driven through the raw `io_uring_setup()` and `io_uring_enter()` system
+ * calls, no library is needed. If the kernel has no io_uring, or it is disabled, the
+ * caller falls back to the synchronous path.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "mygrep.h"
+
+/** Number of files whose I/O is in flight at the same time. */
+#define URING_WINDOW 64
+/** Files up to this size are read through the ring, larger ones are searched with `searchFd()`. */
+#define URING_BUFFER (64 * 1024)
+/** Below this number of input files the synchronous path is used. */
+#define URING_MIN_FILES 8
+/** Returned by `searchFilesUring()` if io_uring cannot be used. */
+#define URING_UNAVAILABLE (-2)
+
+/**
+ * @brief Searches `paths` in order, reading them ahead through io_uring.
+ *
+ * @details A file that cannot be opened or read through the ring is searched with the
+ * synchronous `searchFile()`, so errors are the same as on the synchronous path.
+ *
+ * @param paths Input files.
+ * @param count Number of input files.
+ * @param output Output file pointer.
+ * @param opts Search settings.
+ * @return Index of the first file that could not be opened, -1 if all were searched, or
+ * `URING_UNAVAILABLE` if nothing was searched because io_uring is not available.
+ */
+int searchFilesUring(char* const paths[], int count, FILE* output, const options_t* opts);
+
+#endif // URING_H
@@ -0,0 +1,367 @@
+/**
+ * @file walk.c
+ * @author Phillip Sassmann
+ * @date 4.11.2024
+ *
+ * @brief Parallel recursive traversal of directory trees for `-r`.
+ *
+ * The workers share two pieces of work: a stack of directories that still have to be
+ * read and a bounded FIFO queue of files that still have to be searched. A worker prefers
+ * files, so the queue is drained before more directories are opened. A directory is read
+ * in large `getdents64()` batches; its file descriptor stays open as long as queued files
+ * refer to it, they are opened with `openat()` and need no path lookup from the root.
+ *
+ * When the queue is full, the reading worker searches the oldest queued file itself
+ * before adding the new one. That keeps memory bounded for directories of any size, keeps
+ * the queue in order and can never leave every worker waiting for queue space.
+ *
+ * Every file is searched into its own memory buffer that is written to the output in one
+ * piece, so the lines of different files never interleave.
+ */
+
+#include "walk.h"
+
+#include <dirent.h>
+#include <sys/syscall.h>
+
+/** Size of the buffer for one `getdents64()` call. */
+#define DIRENT_BUFFER (64 * 1024)
+
+/**
+ * @struct linux_dirent64
+ * @brief Record returned by the `getdents64()` system call.
+ */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/**
+ * @struct walkdir
+ * @brief An open directory, referenced by its reader and its queued files.
+ */
+typedef struct walkdir {
+    int fd;
+    char* path;
+    int refs;
+} walkdir_t;
+
+/**
+ * @struct entry
+ * @brief A queued file: its directory and its name in there.
+ */
+typedef struct entry {
+    walkdir_t* dir;
+    char* name;
+} entry_t;
+
+/**
+ * @struct walker
+ * @brief State shared by all workers, guarded by `lock`; `outLock` guards the output.
+ *
+ * @details `opts` is used for every single file, `threads` is the number of workers.
+ * `files` is a ring of `nfiles` entries starting at `head`. `reading` counts
+ * the workers that are reading a directory and may still add work.
+ */
+typedef struct walker {
+    const options_t* opts;
+    int threads;
+    FILE* output;
+    entry_t files[WALK_QUEUE];
+    size_t head;
+    size_t nfiles;
+    char** dirs;
+    size_t ndirs;
+    size_t capdirs;
+    int reading;
+    bool failed;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_mutex_t outLock;
+} walker_t;
+
+
+/**
+ * @brief Returns the path of `name` inside `dir`; an empty `dir` is the current directory.
+ */
+static char* childPath(const char* dir, const char* name){
+    size_t dlen=strlen(dir);
+    char* path=malloc(dlen+strlen(name)+2);
+    if(path==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    if(dlen==0) strcpy(path, name);
+    else sprintf(path, dir[dlen-1]=='/' ? "%s%s" : "%s/%s", dir, name);
+    return path;
+}
+
+
+/**
+ * @brief Prints an error for `path` and remembers that something could not be read.
+ */
+static void walkError(walker_t* w, const char* path){
+    int error=errno;
+    pthread_mutex_lock(&w->outLock);
+    fflush(w->output);
+    fprintf(stderr, "%s: %s\n", path[0]=='\0' ? "." : path, strerror(error));
+    pthread_mutex_unlock(&w->outLock);
+    pthread_mutex_lock(&w->lock);
+    w->failed=true;
+    pthread_mutex_unlock(&w->lock);
+}
+
+
+/**
+ * @brief Drops one reference to a directory and closes it after the last one.
+ *
+ * @details Must be called with `w->lock` held.
+ */
+static void releaseDir(walkdir_t* dir){
+    if(--dir->refs>0) return;
+    close(dir->fd);
+    free(dir->path);
+    free(dir);
+}
+
+
+/**
+ * @brief Searches one file of a directory and writes its output in one piece.
+ */
+static void searchEntry(walker_t* w, const walkdir_t* dir, const char* name){
+    char* path=childPath(dir->path, name);
+    int fd=openat(dir->fd, name, O_RDONLY | O_NOCTTY | O_NOFOLLOW);
+    char* buf=NULL;
+    size_t len=0;
+    FILE* mem;
+
+    if(fd==-1){
+        walkError(w, path);
+        free(path);
+        return;
+    }
+    if(w->threads==1){
+        searchFd(fd, path, w->output, w->opts);
+    }
+    else{
+        if((mem=open_memstream(&buf, &len))==NULL){
+            perror("error in opening memory stream");
+            exit(EXIT_FAILURE);
+        }
+        searchFd(fd, path, mem, w->opts);
+        if(fclose(mem)==EOF){
+            perror("error in closing memory stream");
+            exit(EXIT_FAILURE);
+        }
+        if(len>0){
+            pthread_mutex_lock(&w->outLock);
+            fwrite(buf, len, 1, w->output);
+            pthread_mutex_unlock(&w->outLock);
+        }
+        free(buf);
+    }
+    close(fd);
+    free(path);
+}
+
+
+/**
+ * @brief Takes the oldest queued file and searches it.
+ *
+ * @details Must be called with `w->lock` held and a non-empty queue; the lock is released
+ * while searching.
+ */
+static void searchOldest(walker_t* w){
+    entry_t e=w->files[w->head];
+    w->head=(w->head+1)%WALK_QUEUE;
+    w->nfiles--;
+    pthread_cond_broadcast(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+
+    searchEntry(w, e.dir, e.name);
+    free(e.name);
+
+    pthread_mutex_lock(&w->lock);
+    releaseDir(e.dir);
+}
+
+
+/**
+ * @brief Queues a file of `dir`, searching older files first while the queue is full.
+ */
+static void pushFile(walker_t* w, walkdir_t* dir, const char* name){
+    char* copy=strdup(name);
+    if(copy==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_lock(&w->lock);
+    while(w->nfiles==WALK_QUEUE) searchOldest(w);
+    w->files[(w->head+w->nfiles)%WALK_QUEUE]=(entry_t){ .dir=dir, .name=copy };
+    w->nfiles++;
+    dir->refs++;
+    pthread_cond_signal(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+}
+
+
+/**
+ * @brief Adds a directory to the stack of directories to read, taking over `path`.
+ */
+static void pushDir(walker_t* w, char* path){
+    pthread_mutex_lock(&w->lock);
+    if(w->ndirs==w->capdirs){
+        size_t cap= w->capdirs>0 ? 2*w->capdirs : 64;
+        char** grown=realloc(w->dirs, cap*sizeof(*grown));
+        if(grown==NULL){
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        w->dirs=grown;
+        w->capdirs=cap;
+    }
+    w->dirs[w->ndirs++]=path;
+    pthread_cond_signal(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+}
+
+
+/**
+ * @brief Reads one directory, queueing its regular files and pushing its subdirectories.
+ *
+ * @details Entries of unknown type are looked up with `fstatat()`; symbolic links and
+ * special files are skipped.
+ *
+ * @param w Shared state.
+ * @param path Path of the directory, taken over.
+ * @param buf Buffer of `DIRENT_BUFFER` bytes for the directory entries.
+ */
+static void readDir(walker_t* w, char* path, char* buf){
+    walkdir_t* dir;
+    long n;
+    int fd=open(path[0]=='\0' ? "." : path, O_RDONLY | O_DIRECTORY);
+
+    if(fd==-1){
+        walkError(w, path);
+        free(path);
+        return;
+    }
+    if((dir=malloc(sizeof(*dir)))==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    *dir=(walkdir_t){ .fd=fd, .path=path, .refs=1 };
+
+    while((n=syscall(SYS_getdents64, fd, buf, DIRENT_BUFFER))>0){
+        long pos=0;
+        for(; pos<n; pos+=((struct linux_dirent64*)(buf+pos))->d_reclen){
+            struct linux_dirent64* d=(struct linux_dirent64*)(buf+pos);
+            unsigned char type=d->d_type;
+            struct stat st;
+
+            if(strcmp(d->d_name, ".")==0 || strcmp(d->d_name, "..")==0) continue;
+            if(type==DT_UNKNOWN && fstatat(fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW)==0){
+                type= S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if(type==DT_DIR) pushDir(w, childPath(path, d->d_name));
+            else if(type==DT_REG) pushFile(w, dir, d->d_name);
+        }
+    }
+    if(n==-1) walkError(w, path);
+
+    pthread_mutex_lock(&w->lock);
+    releaseDir(dir);
+    pthread_mutex_unlock(&w->lock);
+}
+
+
+/**
+ * @brief Worker thread, searches files and reads directories until no work is left.
+ *
+ * @details The walk is finished when the queue and the stack are empty and no worker is
+ * reading a directory that could add more.
+ *
+ * @param arg The shared `walker_t`.
+ * @return NULL.
+ */
+static void* walkWorker(void* arg){
+    walker_t* w=arg;
+    char* buf=malloc(DIRENT_BUFFER);
+
+    if(buf==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_lock(&w->lock);
+    for(;;){
+        if(w->nfiles>0){
+            searchOldest(w);
+        }
+        else if(w->ndirs>0){
+            char* path=w->dirs[--w->ndirs];
+            w->reading++;
+            pthread_mutex_unlock(&w->lock);
+
+            readDir(w, path, buf);
+
+            pthread_mutex_lock(&w->lock);
+            w->reading--;
+            pthread_cond_broadcast(&w->changed);
+        }
+        else if(w->reading==0){
+            break;
+        }
+        else{
+            pthread_cond_wait(&w->changed, &w->lock);
+        }
+    }
+    pthread_cond_broadcast(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+    free(buf);
+    return NULL;
+}
+
+
+bool searchTree(char* const paths[], int count, FILE* output, const options_t* opts){
+    options_t single=*opts;
+    walker_t w = { .opts=&single, .threads=opts->threads, .output=output };
+    int threads=opts->threads;
+    pthread_t* tids=malloc(threads*sizeof(*tids));
+    int i=0;
+
+    if(tids==NULL){
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    /* workers search whole files, a large file is not split again */
+    single.threads=1;
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.changed, NULL);
+    pthread_mutex_init(&w.outLock, NULL);
+
+    if(count==0) pushDir(&w, childPath("", ""));
+    for(; i<count; i++){
+        struct stat st;
+        if(stat(paths[i], &st)==-1) walkError(&w, paths[i]);
+        else if(S_ISDIR(st.st_mode)) pushDir(&w, childPath("", paths[i]));
+        else if(!searchFile(paths[i], output, opts)) walkError(&w, paths[i]);
+    }
+
+    for(i=0; i<threads; i++){
+        if(pthread_create(&tids[i], NULL, walkWorker, &w)!=0){
+            perror("error in creating worker thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(i=0; i<threads; i++) pthread_join(tids[i], NULL);
+
+    pthread_mutex_destroy(&w.outLock);
+    pthread_cond_destroy(&w.changed);
+    pthread_mutex_destroy(&w.lock);
+    free(w.dirs);
+    free(tids);
+    return !w.failed;
+}
@@ -0,0 +1,39 @@
+#ifndef WALK_H
+#define WALK_H
+/**
+ * @file walk.h
+ * @brief Recursive, multi-threaded directory search (`-r`) for `mygrep`.
+ *
+ * Directories are read with `getdents64()` by the same worker threads that search the
+ * files. Files found while reading a directory go into a bounded queue and are opened with
+ * `openat()` relative to their directory, so no full list of files is ever built; when the
+ * queue is full, the reading thread searches the file itself. Symbolic links below the
+ * given paths are not followed and binary files are skipped.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "mygrep.h"
+
+/** Capacity of the queue of files waiting to be searched. */
+#define WALK_QUEUE 1024
+
+/**
+ * @brief Searches every regular file below the given paths.
+ *
+ * @details Each file is searched as a whole and its output written at once, but files
+ * are written in the order they finish. With one thread the order is that of a
+ * depth-first traversal.
+ *
+ * @param paths Files and directories to search; a file is searched directly.
+ * @param count Number of paths; with 0 the current directory is searched and the names
+ * are relative to it.
+ * @param output Output file pointer.
+ * @param opts Search settings, `opts->threads` is the number of worker threads.
+ * @return false if a path or directory could not be read; all others are still searched.
+ */
+bool searchTree(char* const paths[], int count, FILE* output, const options_t* opts);
+
+#endif // WALK_H
@@ -3,7 +3,7 @@
 #include <unistd.h>
 #include <assert.h>
 #include <limits.h> //für INT_MAX
-#include <time.h> //für srand
+#include <time.h> //für clock_gettime
 /* für Shared Memory */
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -13,8 +13,13 @@
 #include <errno.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 /* semaphore*/
+#include <ctype.h>
+#include <sys/stat.h>
 #include <semaphore.h>
+#include <pthread.h>
+#include <sched.h>
 
 /**
  * @file common.h
@@ -31,13 +36,21 @@
 
 #define SHM_NAME "/12207461_SHM"
 #define SEM_USED "/12207461_SEMUSED"
-#define SEM_FREE "/12207461_SEMFREE"
-#define SEM_GENERATOR "/12207461_SEMGENERATOR"
 
 
 #define PERMISSIONS 0660
-#define LEN 32
+/** Default size of the solution ring in bytes, set with `supervisor -b`. */
+#define RING_BYTES (64 * 1024)
+/** Default number of removed edges from which on solutions are dropped, set with `supervisor -e`. */
 #define MAX_EDGES 8
+/** Magic bytes at the start of a binary edge list file. */
+#define EDGEFILE_MAGIC "3COLEDGE"
+/** Size of the header of a binary edge list: the magic bytes and the edge count. */
+#define EDGEFILE_HEADER (sizeof(EDGEFILE_MAGIC) - 1 + sizeof(uint64_t))
+/** Number of colourings `colouringBatch()` draws and evaluates at once, one per bit of a word. */
+#define BATCH 64
+/** Number of solutions a generator finds before it adds them to the shared count. */
+#define CANDIDATE_BATCH 64
 
 /**
  * @enum COLOUR
@@ -45,7 +58,7 @@
  *
  * @details `COLOUR` is used to assign one of three possible colors to nodes,
  * allowing validation for 3-coloring of a graph where adjacent nodes should not
- * share the same color.
+ * share the same color. A colouring stores them as one `uint8_t` per node.
  */
 typedef enum COLOUR {
   RED = 0,
@@ -58,10 +71,10 @@ typedef enum COLOUR {
  * @struct node
  * @brief Represents a graph node.
  *
- * @details Each `node_t` instance represents a node with a color and a unique integer value.
+ * @details Each `node_t` instance represents a node by the integer value it was given
+ * on the command line.
  */
 typedef struct node{
-  colour_t colour;
   int value;
 } node_t;
 
@@ -83,32 +96,168 @@ typedef struct edges {
  * @struct edgelist
  * @brief Collection of edges in a graph.
  *
- * @details `edgelist_t` holds multiple edges (up to `MAX_EDGES`) with a `size`
- * attribute that keeps track of the total number of edges in the list. Useful for managing
- * edges involved in the current graph solution.
+ * @details `edgelist_t` refers to `size` edges in a buffer owned by the caller, e.g. the
+ * edges of the current graph solution.
  */
 typedef struct edgelist{
     int size;
-    edges_t list[MAX_EDGES];
+    edges_t *list;
 }edgelist_t;
 
+/**
+ * @struct edgefile
+ * @brief The edges of a graph as read by `readEdges()` or `parseEdges()`.
+ *
+ * @details `map` is the mapping of a binary edge list that `edges` points into, or NULL
+ * if `edges` was allocated.
+ */
+typedef struct edgefile {
+    edges_t *edges;
+    size_t count;
+    void *map;
+    size_t mapSize;
+} edgefile_t;
+
+/**
+ * @struct record
+ * @brief A solution in the ring of the shared segment.
+ *
+ * @details A record takes `RECORD_SIZE(size)` bytes, a multiple of 8, so a header never
+ * wraps around the end of the ring; the edges may. `ready` is set last, once the
+ * record is complete.
+ */
+typedef struct record {
+    uint32_t ready;
+    int32_t size;
+    edges_t list[];
+} record_t;
+
+/** Bytes a record with `n` edges takes in the ring. */
+#define RECORD_SIZE(n) (sizeof(record_t) + (size_t)(n) * sizeof(edges_t))
+
+/**
+ * @struct graph
+ * @brief Graph in compressed sparse row form, built once by the generator.
+ *
+ * @details Nodes are numbered densely from 0 to `nodes`-1, `values` maps such an ID back
+ * to the value of the node. The neighbours of node `u` are `adj[offsets[u]]` up to
+ * `adj[offsets[u+1]]`; every edge appears in the lists of both of its nodes, a self-loop
+ * only once. Duplicate edges are kept, so they are counted like on the command line.
+ */
+typedef struct graph {
+    int nodes;
+    int *values;
+    int *offsets;
+    int *adj;
+} graph_t;
+
+/**
+ * @struct rng
+ * @brief State of a xoshiro256** pseudo random number generator.
+ *
+ * @details Every generator thread owns one, seeded from the pid and the time or from
+ * `-s`, so generators started together draw different colourings.
+ */
+typedef struct rng {
+    uint64_t s[4];
+} rng_t;
+
+/**
+ * @struct batch
+ * @brief `BATCH` colourings of a graph, bit-sliced: two words per node.
+ */
+typedef struct batch {
+    uint64_t *hi;
+    uint64_t *lo;
+} batch_t;
+
+/**
+ * @enum ALGORITHM
+ * @brief Engine a generator uses to find colourings (`-a`).
+ */
+typedef enum ALGORITHM {
+    ALG_RANDOM = 0,     /**< fresh random colourings, evaluated `BATCH` at a time */
+    ALG_MINCONF = 1,    /**< min-conflicts local search with random walk */
+    ALG_TABU = 2,       /**< tabu search over all moves of conflicting nodes */
+    ALG_EXACT = 3       /**< DSATUR branch and bound, proves the minimum */
+} algorithm_t;
+
+/**
+ * @brief Receives a complete colouring the exact search found below the best bound.
+ *
+ * @param arg The argument given to `exactSearch()`.
+ * @param colour The colouring, only valid during the call.
+ * @param conflicts Its number of conflicting edges.
+ * @return false to abort the search.
+ */
+typedef bool (*improve_t)(void *arg, const uint8_t *colour, int conflicts);
+
+/**
+ * @struct localsearch
+ * @brief A colouring that is improved by recolouring one node at a time.
+ *
+ * @details `conf[3*u+c]` is the number of neighbours of `u` that have colour `c`, so
+ * the change of `conflicts` by a move is known without looking at the graph and a move
+ * updates the counts in O(degree). Self-loops are left out of `conf`, no colour removes
+ * them; they are counted once in `selfLoops`. The nodes that have a neighbour of their
+ * own colour are listed in `conflicting`, `where[u]` is the position of `u` there or -1.
+ * `tabu[3*u+c]` is the step until which `u` may not get colour `c` back, `best` the
+ * fewest conflicts seen since the last restart.
+ */
+typedef struct localsearch {
+    const graph_t *graph;
+    uint8_t *colour;
+    int *conf;
+    int *conflicting;
+    int *where;
+    int nconflicting;
+    long *tabu;
+    int selfLoops;
+    int conflicts;
+    int best;
+    long step;
+} localsearch_t;
+
 /**
  * @struct circularbuffer
- * @brief Circular buffer for storing solutions.
+ * @brief Shared segment: settings of the run and a lock-free ring of solution records.
+ *
+ * @details The supervisor sizes the segment at runtime, `ring` has `capacity` bytes. It
+ * passes variable-length records from many generator processes to the supervisor
+ * without a lock. `write_pos` and `read_pos` are byte positions that only grow, a
+ * position is at `pos % capacity` in the ring. A generator reserves the bytes of its
+ * record with an atomic fetch-and-add on `write_pos`, waits until the supervisor has
+ * read far enough that they are free, writes the record and sets its `ready` flag. The
+ * supervisor reads the record at `read_pos` once it is ready, clears its bytes and
+ * advances `read_pos`. `SEM_USED` counts the published records so that the supervisor
+ * can sleep. `stop` tells the generators to terminate. An exact generator that has
+ * searched all colourings sets `proven`: then `best` is the minimum.
  *
- * @details `circularbuffer_t` manages solutions generated by multiple processes
- * using shared memory. It contains indicators for read/write positions, number of
- * generators, and a stop flag for halting execution.
+ * `maxEdges` (`-e`) is the number of removed edges from which on solutions are dropped.
+ * `best` is the size of the best solution published so far; a generator only publishes
+ * a solution after lowering `best` to its size, so only strict improvements pass through
+ * the buffer. `candidates` counts all solutions below `maxEdges` the generators found,
+ * published or not; the generator that takes it past `limit` (`-n`) stops the run.
+ * `best` is read by every attempt and sits on its own cache line, as do the counters
+ * every generator writes and the position the supervisor writes.
  */
 typedef struct circularbuffer {
     bool stop;
-    unsigned int read_pos;
-    unsigned int write_pos;
-    unsigned int numGen;
-    edgelist_t solution[LEN];
+    bool proven;
+    long limit;
+    int maxEdges;
+    uint64_t capacity;
+    uint64_t read_pos __attribute__((aligned(64)));
+    int best __attribute__((aligned(64)));
+    uint64_t write_pos __attribute__((aligned(64)));
+    long candidates;
+    char ring[] __attribute__((aligned(64)));
 } circularbuffer_t;
 
 
+/** Set by the signal handler, every loop of a process checks it. */
+extern volatile sig_atomic_t quit;
+
 /**
  * @brief Handles received signals to set a quit flag for terminating processes.
  *
@@ -139,13 +288,168 @@ void usage(char* errormsg);
 void printEdges(edgelist_t solution);
 
 /**
- * @brief Attempts to generate a 3-colorable solution for the graph.
+ * @brief Copies `len` bytes to byte position `pos` of the ring, wrapping around its end.
+ */
+void ringWrite(circularbuffer_t *circularbuffer, uint64_t pos, const void *src, size_t len);
+
+/**
+ * @brief Copies `len` bytes from byte position `pos` of the ring, wrapping around its end.
+ */
+void ringRead(const circularbuffer_t *circularbuffer, uint64_t pos, void *dst, size_t len);
+
+/**
+ * @brief Zeroes `len` bytes from byte position `pos` of the ring, wrapping around its end.
+ */
+void ringClear(circularbuffer_t *circularbuffer, uint64_t pos, size_t len);
+
+/**
+ * @brief Parses edges given as `a-b` tokens, e.g. on the command line.
  *
- * @details Uses a randomized algorithm to color graph nodes and returns an
- * `edgelist_t` containing any edges where adjacent nodes have the same color.
+ * @param tokens The tokens.
+ * @param count Number of tokens.
+ * @param file Receives the edges, released with `closeEdges()`.
+ * @return false if a token is not an edge.
+ */
+bool parseEdges(char *const tokens[], int count, edgefile_t *file);
+
+/**
+ * @brief Reads the edges of a graph from a file.
+ *
+ * @param path A binary edge list or a text file of white-space separated `a-b` edges;
+ * `-` reads text from stdin.
+ * @param file Receives the edges, released with `closeEdges()`.
+ * @return false if the file cannot be read or is malformed, with `errno` set.
+ */
+bool readEdges(const char *path, edgefile_t *file);
+
+/**
+ * @brief Releases the edges read by `readEdges()` or `parseEdges()`.
+ */
+void closeEdges(edgefile_t *file);
+
+/**
+ * @brief Maps the node values of the edges to dense IDs and builds the adjacency.
  *
  * @param params Array of edges representing the graph.
  * @param size Number of edges in the `params` array.
- * @return edgelist_t List of edges that do not satisfy the 3-coloring condition.
+ * @param graph The graph to fill, released with `freeGraph()`.
+ */
+void buildGraph(const edges_t *params, int size, graph_t *graph);
+
+/**
+ * @brief Releases the arrays of a graph built by `buildGraph()`.
+ */
+void freeGraph(graph_t *graph);
+
+/**
+ * @brief Removes the nodes that can always be coloured afterwards and splits the rest
+ * into its connected components.
+ *
+ * @details The conflicts of the graph are the sum of the conflicts of the parts, every
+ * part can be coloured on its own.
+ *
+ * @param graph The graph.
+ * @param parts Receives an array of the parts, each released with `freeGraph()`, the
+ * array with `free()`.
+ * @return The number of parts; 0 if the graph is 3-colourable.
+ */
+int reduceGraph(const graph_t *graph, graph_t **parts);
+
+/**
+ * @brief Seeds a random number generator.
+ *
+ * @param rng The generator.
+ * @param seed Any value, it is spread over the whole state with splitmix64.
+ */
+void seedRandom(rng_t *rng, uint64_t seed);
+
+/**
+ * @brief Returns the next 64 random bits of a generator.
+ */
+uint64_t nextRandom(rng_t *rng);
+
+/**
+ * @brief Gives each of `nodes` nodes a uniformly random colour.
+ */
+void randomColours(uint8_t *colour, int nodes, rng_t *rng);
+
+/**
+ * @brief Collects the edges of a colouring whose nodes share a colour, at most `limit`.
+ *
+ * @param graph The graph.
+ * @param colour The colouring.
+ * @param list Buffer for `limit` edges.
+ * @param limit Number of edges after which the search stops.
+ * @return The number of conflicting edges; `limit` if there are that many or more.
+ */
+int conflictingEdges(const graph_t *graph, const uint8_t *colour, edges_t *list, int limit);
+
+/**
+ * @brief Sets up a local search and starts it from a random colouring.
+ *
+ * @param ls The search to initialise, released with `freeSearch()`.
+ * @param graph The graph.
+ * @param colour Array of `graph->nodes` entries that holds the current colouring.
+ * @param rng Random number generator of the calling thread.
+ */
+void initSearch(localsearch_t *ls, const graph_t *graph, uint8_t *colour, rng_t *rng);
+
+/**
+ * @brief Starts the search again from a new random colouring.
+ */
+void restartSearch(localsearch_t *ls, rng_t *rng);
+
+/**
+ * @brief Recolours one conflicting node, chosen by `alg`.
+ *
+ * @details Does nothing if no node can remove a conflict any more.
+ */
+void searchStep(localsearch_t *ls, algorithm_t alg, rng_t *rng);
+
+/**
+ * @brief Releases the arrays of a local search.
+ */
+void freeSearch(localsearch_t *ls);
+
+/**
+ * @brief Finds the fewest conflicting edges of any colouring, with `threads` threads.
+ *
+ * @details Every colouring below `*best` is passed to `improve`, which is expected to
+ * lower `*best`; the search prunes with whatever `*best` is at the time, so a colouring
+ * found by one thread prunes the others as well.
+ *
+ * @param graph The graph.
+ * @param threads Number of threads that share the search tree.
+ * @param budget Seconds after which the search gives up, 0 for no limit.
+ * @param best Fewest conflicts known for `graph`, e.g. the bound of one component.
+ * @param stop Shared flag that aborts the search.
+ * @param improve Receives the colourings below the bound.
+ * @param arg Passed to `improve`.
+ * @return true if the whole tree was searched, then no colouring has fewer conflicts
+ * than `*best`.
+ */
+bool exactSearch(const graph_t *graph, int threads, double budget, int *best, bool *stop,
+                 improve_t improve, void *arg);
+
+/**
+ * @brief Draws `BATCH` random colourings and counts the conflicts of all of them at once.
+ *
+ * @details The colourings are bit-sliced: bit `l` of `batch->hi[u]` and `batch->lo[u]`
+ * is the colour of node `u` in colouring `l`. The conflicts of one edge in all
+ * colourings are then a few bitwise operations, and the per-colouring counts are kept
+ * as bit-sliced counters as well.
+ *
+ * @param graph The graph.
+ * @param batch Two words per node that receive the colourings.
+ * @param rng Random number generator of the calling thread.
+ * @param limit Number of conflicts from which on a colouring is of no interest.
+ * @param lane Receives the index of the colouring with the fewest conflicts.
+ * @param solutions Receives the number of colourings with fewer than `limit` conflicts.
+ * @return The fewest conflicts of any colouring, `limit` if all have that many or more.
+ */
+int colouringBatch(const graph_t *graph, batch_t *batch, rng_t *rng, int limit, int *lane, int *solutions);
+
+/**
+ * @brief Extracts colouring `lane` of a batch into one colour per node.
  */
-edgelist_t colouring(edges_t *params, int size);
\ No newline at end of file
+void batchColours(const graph_t *graph, const batch_t *batch, int lane, uint8_t *colour);
@@ -0,0 +1,474 @@
+#include "common.h"
+
+
+/**
+ * @file exact.c
+ * @author Phillip Sassmann
+ * @date 12.11.2024
+ *
+ * @brief Exact engine of the generator: DSATUR branch and bound over all colourings.
+ *
+ * @details The search colours one node per level, always the uncoloured node with the
+ * most different colours among its neighbours (DSATUR), and tries its colours with the
+ * fewest new conflicts first. Colours are interchangeable, so a node only gets a colour
+ * that is already used or the next unused one. A subtree is cut off once the conflicts
+ * so far plus a lower bound for the uncoloured nodes reach the best bound `*best` of the
+ * caller. The generator searches the components of the graph one after the other and
+ * passes the bound of the component, so only colourings of that component prune.
+ *
+ * The tree is split into subtrees, given as the colours of their first nodes. Every
+ * thread owns a deque of them, takes its own from the bottom and steals from the top of
+ * the others' when it runs dry. A thread that sees idle threads gives its shallowest
+ * untried siblings away, so the subtrees are about as large as the idle threads need.
+ */
+
+
+/** Colour of a node that has not been coloured yet. */
+#define UNCOLOURED 3
+/** Nodes a thread visits between two looks at the clock and the stop flags. */
+#define CHECK_NODES 4096
+
+
+/**
+ * @struct choice
+ * @brief A node and the colour it gets.
+ */
+typedef struct choice {
+    int node;
+    int colour;
+} choice_t;
+
+/**
+ * @struct task
+ * @brief A subtree, given by the colours of the `depth` nodes on the path to it.
+ */
+typedef struct task {
+    int depth;
+    choice_t *path;
+} task_t;
+
+/**
+ * @struct deque
+ * @brief Subtrees of one thread, `tasks[head]` up to `tasks[tail]`.
+ *
+ * @details The owner pushes and pops at `tail`, thieves take the oldest and largest
+ * subtrees at `head`. `count` may be read without the lock as a hint.
+ */
+typedef struct deque {
+    pthread_mutex_t lock;
+    task_t *tasks;
+    int head;
+    int tail;
+    int capacity;
+    int count;
+} __attribute__((aligned(64))) deque_t;
+
+/**
+ * @struct exact
+ * @brief State shared by the threads of one exact search.
+ *
+ * @details `idle` counts the threads that have no subtree; once all of them are idle
+ * the tree is exhausted. `abort` ends the search early, without a result.
+ */
+typedef struct exact {
+    const graph_t *graph;
+    int threads;
+    int selfLoops;
+    int *best;
+    bool *stop;
+    improve_t improve;
+    void *arg;
+    bool budget;
+    struct timespec deadline;
+    deque_t *deques;
+    int idle __attribute__((aligned(64)));
+    bool abort;
+} exact_t;
+
+/**
+ * @struct solver
+ * @brief Search state of one thread.
+ *
+ * @details `conf[3*u+c]` is the number of coloured neighbours of `u` with colour `c`,
+ * self-loops left out. `bound` is the sum over all uncoloured nodes of their fewest
+ * conflicts with any colour, a lower bound for the conflicts still to come, since every
+ * edge to a coloured node is counted only at its uncoloured end. `node[d]` is the node
+ * coloured on level `d`, `order[3*d]` up to `order[3*d+options[d]]` the colours it
+ * tries, `next[d]` the next of them and `used[d]` the number of colours in use above.
+ */
+typedef struct solver {
+    exact_t *ex;
+    int id;
+    uint8_t *colour;
+    int *conf;
+    int conflicts;
+    int bound;
+    int *node;
+    uint8_t *order;
+    uint8_t *options;
+    uint8_t *next;
+    uint8_t *used;
+    long visited;
+    pthread_t tid;
+} __attribute__((aligned(64))) solver_t;
+
+
+static int fewest(const int *conf){
+    int m = conf[0] < conf[1] ? conf[0] : conf[1];
+    return m < conf[2] ? m : conf[2];
+}
+
+
+/**
+ * @brief Gives the uncoloured node `u` colour `c` and updates the counts of its neighbours.
+ */
+static void assign(solver_t *s, int u, int c){
+    const graph_t *graph = s->ex->graph;
+    int k = graph->offsets[u];
+
+    s->bound -= fewest(&s->conf[3*u]);
+    s->conflicts += s->conf[3*u+c];
+    s->colour[u] = c;
+    for(; k<graph->offsets[u+1]; k++){
+        int v = graph->adj[k];
+        if(v == u) continue;
+        if(s->colour[v] == UNCOLOURED){
+            int before = fewest(&s->conf[3*v]);
+            s->conf[3*v+c]++;
+            s->bound += fewest(&s->conf[3*v]) - before;
+        }
+        else s->conf[3*v+c]++;
+    }
+}
+
+
+/**
+ * @brief Takes the colour of `u` back, the reverse of `assign()`.
+ */
+static void unassign(solver_t *s, int u){
+    const graph_t *graph = s->ex->graph;
+    int c = s->colour[u];
+    int k = graph->offsets[u];
+
+    for(; k<graph->offsets[u+1]; k++){
+        int v = graph->adj[k];
+        if(v == u) continue;
+        if(s->colour[v] == UNCOLOURED){
+            int before = fewest(&s->conf[3*v]);
+            s->conf[3*v+c]--;
+            s->bound += fewest(&s->conf[3*v]) - before;
+        }
+        else s->conf[3*v+c]--;
+    }
+    s->colour[u] = UNCOLOURED;
+    s->conflicts -= s->conf[3*u+c];
+    s->bound += fewest(&s->conf[3*u]);
+}
+
+
+/**
+ * @brief Returns the uncoloured node with the most colours among its neighbours, the
+ * one with the most neighbours among equals.
+ */
+static int saturated(const solver_t *s){
+    const graph_t *graph = s->ex->graph;
+    int u = 0, best = -1;
+    long bestKey = -1;
+
+    for(; u<graph->nodes; u++){
+        const int *conf = &s->conf[3*u];
+        long key;
+        if(s->colour[u] != UNCOLOURED) continue;
+        key = (long)((conf[0] > 0) + (conf[1] > 0) + (conf[2] > 0)) << 32;
+        key |= graph->offsets[u+1] - graph->offsets[u];
+        if(key > bestKey){
+            bestKey = key;
+            best = u;
+        }
+    }
+    return best;
+}
+
+
+static void push(deque_t *dq, const task_t *task){
+    pthread_mutex_lock(&dq->lock);
+    if(dq->tail == dq->capacity){
+        if(dq->head > 0){
+            memmove(dq->tasks, dq->tasks + dq->head, (dq->tail - dq->head) * sizeof(task_t));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        }
+        else{
+            dq->capacity = dq->capacity > 0 ? 2 * dq->capacity : 16;
+            dq->tasks = realloc(dq->tasks, dq->capacity * sizeof(task_t));
+            if(dq->tasks == NULL){
+                perror("error in allocating memory");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    dq->tasks[dq->tail++] = *task;
+    __atomic_store_n(&dq->count, dq->tail - dq->head, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&dq->lock);
+}
+
+
+/**
+ * @brief Takes a subtree from the bottom of the own deque or, with `idle` given, from the
+ * top of another thread's deque.
+ *
+ * @details A thief leaves the idle threads in the same critical section in which it
+ * takes the subtree, so no subtree is ever out of a deque while all threads count as
+ * idle.
+ */
+static bool pop(deque_t *dq, task_t *task, int *idle){
+    bool found;
+
+    pthread_mutex_lock(&dq->lock);
+    found = dq->head < dq->tail;
+    if(found){
+        if(idle == NULL) *task = dq->tasks[--dq->tail];
+        else{
+            *task = dq->tasks[dq->head++];
+            __atomic_fetch_sub(idle, 1, __ATOMIC_RELAXED);
+        }
+        if(dq->head == dq->tail) dq->head = dq->tail = 0;
+        __atomic_store_n(&dq->count, dq->tail - dq->head, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+
+/**
+ * @brief Ends the search early if a signal came, the run stopped or the time is up.
+ */
+static bool aborted(exact_t *ex){
+    struct timespec now;
+
+    if(__atomic_load_n(&ex->abort, __ATOMIC_RELAXED)) return true;
+    if(quit || __atomic_load_n(ex->stop, __ATOMIC_ACQUIRE)){
+        __atomic_store_n(&ex->abort, true, __ATOMIC_RELAXED);
+        return true;
+    }
+    if(ex->budget){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(now.tv_sec > ex->deadline.tv_sec
+           || (now.tv_sec == ex->deadline.tv_sec && now.tv_nsec >= ex->deadline.tv_nsec)){
+            __atomic_store_n(&ex->abort, true, __ATOMIC_RELAXED);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Waits for a subtree, the own ones first, then those of the other threads.
+ *
+ * @return false once every thread is idle or the search was aborted.
+ */
+static bool takeTask(solver_t *s, task_t *task){
+    exact_t *ex = s->ex;
+
+    if(pop(&ex->deques[s->id], task, NULL)) return true;
+    __atomic_fetch_add(&ex->idle, 1, __ATOMIC_RELAXED);
+    for(;;){
+        int i = 1;
+        for(; i<ex->threads; i++){
+            deque_t *victim = &ex->deques[(s->id + i) % ex->threads];
+            if(__atomic_load_n(&victim->count, __ATOMIC_RELAXED) > 0 && pop(victim, task, &ex->idle)) return true;
+        }
+        if(__atomic_load_n(&ex->idle, __ATOMIC_RELAXED) == ex->threads || aborted(ex)) return false;
+        sched_yield();
+    }
+}
+
+
+/**
+ * @brief Gives the untried colours of the shallowest level that has any away as subtrees.
+ */
+static void share(solver_t *s, int base, int depth){
+    int level = base;
+
+    for(; level<depth; level++){
+        if(s->next[level] < s->options[level]) break;
+    }
+    for(; level<depth && s->next[level] < s->options[level]; s->next[level]++){
+        task_t task = { .depth=level+1, .path=malloc((level+1) * sizeof(choice_t)) };
+        int d = 0;
+        if(task.path == NULL){
+            perror("error in allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        for(; d<level; d++){
+            task.path[d].node = s->node[d];
+            task.path[d].colour = s->colour[s->node[d]];
+        }
+        task.path[level].node = s->node[level];
+        task.path[level].colour = s->order[3*level+s->next[level]];
+        push(&s->ex->deques[s->id], &task);
+    }
+}
+
+
+/**
+ * @brief Searches one subtree depth first.
+ *
+ * @details The path to the subtree is coloured from scratch, then the levels below are
+ * walked without recursion, the graphs may be deep.
+ */
+static void solve(solver_t *s, const task_t *task){
+    exact_t *ex = s->ex;
+    const graph_t *graph = ex->graph;
+    int base = task->depth, depth, u = 0, colours = 0;
+
+    memset(s->colour, UNCOLOURED, graph->nodes);
+    memset(s->conf, 0, 3 * (size_t)graph->nodes * sizeof(int));
+    s->conflicts = ex->selfLoops;
+    s->bound = 0;
+    for(; u<base; u++){
+        s->node[u] = task->path[u].node;
+        assign(s, task->path[u].node, task->path[u].colour);
+        if(task->path[u].colour >= colours) colours = task->path[u].colour + 1;
+    }
+
+    for(depth = base;;){
+        /* a new level: prune, take a complete colouring or choose the next node */
+        bool leave = false;
+        if(++s->visited % CHECK_NODES == 0 && aborted(ex)) return;
+        if(s->conflicts + s->bound >= __atomic_load_n(ex->best, __ATOMIC_RELAXED)) leave = true;
+        else if(depth == graph->nodes){
+            if(!ex->improve(ex->arg, s->colour, s->conflicts)){
+                __atomic_store_n(&ex->abort, true, __ATOMIC_RELAXED);
+                return;
+            }
+            leave = true;
+        }
+        else{
+            int v = saturated(s), n = colours < 3 ? colours + 1 : 3, i = 0, j;
+            uint8_t *order = &s->order[3*depth];
+            /* only the colours in use and one new one, the fewest conflicts first */
+            for(; i<n; i++){
+                for(j = i; j>0 && s->conf[3*v+order[j-1]] > s->conf[3*v+i]; j--) order[j] = order[j-1];
+                order[j] = i;
+            }
+            s->node[depth] = v;
+            s->options[depth] = n;
+            s->next[depth] = 0;
+            s->used[depth] = colours;
+            if(__atomic_load_n(&ex->idle, __ATOMIC_RELAXED) > 0
+               && __atomic_load_n(&ex->deques[s->id].count, __ATOMIC_RELAXED) == 0) share(s, base, depth);
+        }
+
+        /* descend into the next colour of this level or go up to a level that has one */
+        if(leave){
+            if(depth == base) return;
+            depth--;
+            unassign(s, s->node[depth]);
+            colours = s->used[depth];
+        }
+        while(s->next[depth] == s->options[depth]){
+            if(depth == base) return;
+            depth--;
+            unassign(s, s->node[depth]);
+            colours = s->used[depth];
+        }
+        {
+            int c = s->order[3*depth+s->next[depth]++];
+            assign(s, s->node[depth], c);
+            if(c == colours) colours++;
+            depth++;
+        }
+    }
+}
+
+
+static void *solver(void *arg){
+    solver_t *s = arg;
+    task_t task;
+
+    while(takeTask(s, &task)){
+        if(!__atomic_load_n(&s->ex->abort, __ATOMIC_RELAXED)) solve(s, &task);
+        free(task.path);
+    }
+    return NULL;
+}
+
+
+bool exactSearch(const graph_t *graph, int threads, double budget, int *best, bool *stop,
+                 improve_t improve, void *arg){
+    exact_t ex = { .graph=graph, .threads=threads, .best=best, .stop=stop, .improve=improve,
+                   .arg=arg, .budget=budget > 0 };
+    task_t root = { .depth=0, .path=NULL };
+    solver_t *solvers;
+    int i = 0, u = 0;
+
+    for(; u<graph->nodes; u++){
+        int k = graph->offsets[u];
+        for(; k<graph->offsets[u+1]; k++) ex.selfLoops += graph->adj[k] == u;
+    }
+    if(ex.budget){
+        clock_gettime(CLOCK_MONOTONIC, &ex.deadline);
+        ex.deadline.tv_sec += (time_t)budget;
+        ex.deadline.tv_nsec += (long)((budget - (time_t)budget) * 1e9);
+        if(ex.deadline.tv_nsec >= 1000000000L){
+            ex.deadline.tv_sec++;
+            ex.deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    ex.deques = calloc(threads, sizeof(deque_t));
+    if(posix_memalign((void **)&solvers, sizeof(solver_t), threads * sizeof(solver_t)) != 0 || ex.deques == NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    for(; i<threads; i++){
+        solver_t *s = &solvers[i];
+        pthread_mutex_init(&ex.deques[i].lock, NULL);
+        s->ex = &ex;
+        s->id = i;
+        s->visited = 0;
+        s->colour = malloc(graph->nodes);
+        s->conf = malloc(3 * (size_t)graph->nodes * sizeof(int));
+        s->node = malloc(graph->nodes * sizeof(int));
+        s->order = malloc(3 * (size_t)graph->nodes);
+        s->options = malloc(graph->nodes);
+        s->next = malloc(graph->nodes);
+        s->used = malloc(graph->nodes);
+        if(s->colour == NULL || s->conf == NULL || s->node == NULL || s->order == NULL
+           || s->options == NULL || s->next == NULL || s->used == NULL){
+            perror("error in allocating memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+    /* the whole tree starts in the first deque, the others steal from it */
+    push(&ex.deques[0], &root);
+
+    for(i=0; i<threads; i++){
+        if(pthread_create(&solvers[i].tid, NULL, solver, &solvers[i]) != 0){
+            perror("error in creating worker thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(i=0; i<threads; i++){
+        pthread_join(solvers[i].tid, NULL);
+    }
+
+    for(i=0; i<threads; i++){
+        task_t left;
+        while(pop(&ex.deques[i], &left, NULL)) free(left.path);
+        pthread_mutex_destroy(&ex.deques[i].lock);
+        free(ex.deques[i].tasks);
+        free(solvers[i].colour);
+        free(solvers[i].conf);
+        free(solvers[i].node);
+        free(solvers[i].order);
+        free(solvers[i].options);
+        free(solvers[i].next);
+        free(solvers[i].used);
+    }
+    free(ex.deques);
+    free(solvers);
+    return !ex.abort;
+}
@@ -14,6 +14,85 @@
 char* myprog;
 volatile sig_atomic_t quit = 0;
 
+/** Steps per node after which a local search without progress starts over. */
+#define STALL_STEPS 100
+/** Attempts a worker makes on one part of the graph before it turns to its next part. */
+#define SLICE 1024
+
+/**
+ * @struct component
+ * @brief A part of the reduced graph, coloured independently of the other parts.
+ *
+ * @details `best` is the fewest conflicts found in the part, `maxEdges` as long as no
+ * solution below that is known, and `list` holds the conflicting edges of that solution.
+ * Both are written under the lock of the generator.
+ */
+typedef struct component {
+    graph_t graph;
+    int best;
+    edges_t *list;
+} component_t;
+
+/**
+ * @struct generator
+ * @brief State shared by all worker threads of a generator process.
+ *
+ * @details The solution of the graph is the union of the solutions of its `nparts`
+ * parts. `missing` counts the parts that have none yet, `total` is the sum of the
+ * `best` of the others.
+ */
+typedef struct generator {
+    algorithm_t alg;
+    component_t *parts;
+    int nparts;
+    circularbuffer_t *circularbuffer;
+    int maxEdges;
+    sem_t *sem_used;
+    pthread_mutex_t lock;
+    int missing;
+    int total;
+} generator_t;
+
+/**
+ * @struct assignment
+ * @brief A part a worker colours, with the colouring the worker keeps for it.
+ */
+typedef struct assignment {
+    component_t *part;
+    uint8_t *colour;
+    localsearch_t ls;
+    int best;
+    long lastImproved;
+} assignment_t;
+
+/**
+ * @struct worker
+ * @brief State of one colouring thread.
+ *
+ * @details Every worker has its own random number generator, parts, batch and buffer
+ * for the edges of a solution (`maxEdges` of them). The
+ * struct is cache-line aligned, so the random state one thread updates on every draw
+ * never shares a line with another thread's.
+ */
+typedef struct worker {
+    generator_t *gen;
+    rng_t rng;
+    assignment_t *own;
+    int nown;
+    batch_t batch;
+    edges_t *list;
+    pthread_t tid;
+} __attribute__((aligned(64))) worker_t;
+
+/**
+ * @struct exactpart
+ * @brief Argument of `publishExact()`: the part the exact search is working on.
+ */
+typedef struct exactpart {
+    generator_t *gen;
+    component_t *part;
+} exactpart_t;
+
 
 
 /**
@@ -26,10 +105,228 @@ void handle_signal(int signal) {
 }
 
 
+/**
+ * @brief Writes a solution as a record into the ring.
+ *
+ * @details This is the one publication path of all workers, it takes no lock: the bytes
+ * of the record are reserved with an atomic fetch-and-add, written once the supervisor
+ * has read past them, and handed over by setting `ready`. Publishing is rare, only
+ * improvements of the global best are published, so waiting for space just polls.
+ *
+ * @param gen Shared generator state.
+ * @param solution The solution to publish.
+ * @return false if the run was stopped while waiting for space; a generator terminated
+ *         while waiting stops the run itself, as its reserved record is never handed over.
+ */
+static bool publish(const generator_t *gen, const edgelist_t *solution){
+    circularbuffer_t *circularbuffer=gen->circularbuffer;
+    size_t len=RECORD_SIZE(solution->size);
+    record_t header = { .ready=0, .size=solution->size };
+    struct timespec pause = { 0, 100000 };
+
+    uint64_t pos=__atomic_fetch_add(&circularbuffer->write_pos, len, __ATOMIC_RELAXED);
+    while(pos+len-__atomic_load_n(&circularbuffer->read_pos, __ATOMIC_ACQUIRE)>circularbuffer->capacity){
+        if(__atomic_load_n(&circularbuffer->stop, __ATOMIC_ACQUIRE)) return false;
+        if(quit){
+            /* the reserved record never becomes ready, so the run ends and the supervisor is woken */
+            __atomic_store_n(&circularbuffer->stop, true, __ATOMIC_RELEASE);
+            sem_post(gen->sem_used);
+            return false;
+        }
+        nanosleep(&pause, NULL);
+    }
+    ringWrite(circularbuffer, pos+sizeof(record_t), solution->list, len-sizeof(record_t));
+    ringWrite(circularbuffer, pos, &header, sizeof(header));
+    __atomic_store_n((uint32_t *)(circularbuffer->ring+pos % circularbuffer->capacity), 1, __ATOMIC_RELEASE);
+
+    if(sem_post(gen->sem_used)==-1){
+        perror("error in semaphore posting (generator)");
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Lowers the global best to `size` if that is a strict improvement.
+ *
+ * @return true if the caller has to publish its solution.
+ */
+static bool improves(circularbuffer_t *circularbuffer, int size){
+    int best=__atomic_load_n(&circularbuffer->best, __ATOMIC_ACQUIRE);
+    while(size<best && !__atomic_compare_exchange_n(&circularbuffer->best, &best, size,
+                                                    false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return size<best;
+}
+
+
+/**
+ * @brief Records a better solution of one part and combines the parts into a solution
+ * of the graph.
+ *
+ * @param gen Shared generator state.
+ * @param part The part.
+ * @param colour Colouring of the part with `conflicts` conflicting edges.
+ * @param conflicts Number of conflicting edges, below `maxEdges`.
+ * @param solution Receives the union of the solutions of all parts.
+ * @return true if that union improves the global best and has to be published.
+ */
+static bool improvePart(generator_t *gen, component_t *part, const uint8_t *colour, int conflicts,
+                        edgelist_t *solution){
+    bool publishable=false;
+    int i=0;
+
+    pthread_mutex_lock(&gen->lock);
+    if(conflicts<part->best){
+        if(part->best>=gen->maxEdges) gen->missing--;
+        else gen->total-=part->best;
+        gen->total+=conflicts;
+        conflictingEdges(&part->graph, colour, part->list, gen->maxEdges);
+        __atomic_store_n(&part->best, conflicts, __ATOMIC_RELAXED);
+        /* the parts make a solution once each of them has one */
+        publishable=gen->missing==0 && gen->total<gen->maxEdges && improves(gen->circularbuffer, gen->total);
+    }
+    if(publishable){
+        solution->size=0;
+        for(; i<gen->nparts; i++){
+            memcpy(solution->list+solution->size, gen->parts[i].list, gen->parts[i].best*sizeof(edges_t));
+            solution->size+=gen->parts[i].best;
+        }
+    }
+    pthread_mutex_unlock(&gen->lock);
+    return publishable;
+}
+
+
+/**
+ * @brief Counts `n` solutions below `maxEdges`, adding them to the shared count in batches.
+ *
+ * @return false if these solutions took the count past the limit and stopped the run.
+ */
+static bool countSolutions(const generator_t *gen, int *found, int n){
+    circularbuffer_t *circularbuffer=gen->circularbuffer;
+
+    *found+=n;
+    if(*found<CANDIDATE_BATCH) return true;
+    if(__atomic_add_fetch(&circularbuffer->candidates, *found, __ATOMIC_RELAXED)>circularbuffer->limit){
+        /* limit reached, the supervisor is woken to see the stop flag */
+        __atomic_store_n(&circularbuffer->stop, true, __ATOMIC_RELEASE);
+        sem_post(gen->sem_used);
+        return false;
+    }
+    *found=0;
+    return true;
+}
+
+
+/**
+ * @brief Colouring thread, tries colourings until the run stops.
+ *
+ * @details A worker takes turns on its parts, `SLICE` attempts at a time, and leaves a
+ * part alone once it is free of conflicts. With `-a random` every attempt is a batch
+ * of `BATCH` fresh random colourings, the best of which is considered for publication.
+ * The local search engines keep one colouring per part, every step is a solution of
+ * its own; a search that has not improved for `STALL_STEPS` steps per node starts over
+ * from a random colouring. Solutions below `maxEdges` are counted in batches, only
+ * strict improvements of the global best are published.
+ *
+ * @param arg The `worker_t` of the thread.
+ * @return NULL.
+ */
+static void *work(void *arg){
+    worker_t *w=arg;
+    generator_t *gen=w->gen;
+    circularbuffer_t *circularbuffer=gen->circularbuffer;
+    int found=0, lane=0, solutions, turn=0, finished=0;
+    bool running=true;
+
+    while(running && finished<w->nown){
+        assignment_t *a=&w->own[turn++ % w->nown];
+        component_t *part=a->part;
+        long stall=(long)STALL_STEPS*part->graph.nodes;
+        int attempt=0;
+
+        if(__atomic_load_n(&part->best, __ATOMIC_RELAXED)==0){
+            finished++;
+            continue;
+        }
+        finished=0;
+
+        for(; attempt<SLICE; attempt++){
+            edgelist_t solution = { .list=w->list };
+            int conflicts;
+
+            if(quit || __atomic_load_n(&circularbuffer->stop, __ATOMIC_ACQUIRE)){
+                running=false;
+                break;
+            }
+            if(gen->alg==ALG_RANDOM){
+                conflicts=colouringBatch(&part->graph, &w->batch, &w->rng, gen->maxEdges, &lane, &solutions);
+                if(conflicts>=gen->maxEdges) continue;
+                if(!countSolutions(gen, &found, solutions)){
+                    running=false;
+                    break;
+                }
+                if(conflicts>=__atomic_load_n(&part->best, __ATOMIC_RELAXED)) continue;
+                batchColours(&part->graph, &w->batch, lane, a->colour);
+            }
+            else{
+                searchStep(&a->ls, gen->alg, &w->rng);
+                if(a->ls.best<a->best){
+                    a->best=a->ls.best;
+                    a->lastImproved=a->ls.step;
+                }
+                else if(a->ls.step-a->lastImproved>stall || a->ls.nconflicting==0){
+                    restartSearch(&a->ls, &w->rng);
+                    a->best=a->ls.best;
+                    a->lastImproved=0;
+                }
+                conflicts=a->ls.conflicts;
+                if(conflicts>=gen->maxEdges) continue;
+                if(!countSolutions(gen, &found, 1)){
+                    running=false;
+                    break;
+                }
+                if(conflicts>=__atomic_load_n(&part->best, __ATOMIC_RELAXED)) continue;
+            }
+
+            if(improvePart(gen, part, a->colour, conflicts, &solution) && !publish(gen, &solution)){
+                running=false;
+                break;
+            }
+            if(conflicts==0) break;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * @brief Publishes a colouring of the exact search, the `improve_t` of `-a exact`.
+ *
+ * @details The exact search only calls this for colourings of a part below its best,
+ * which is at most `maxEdges`, so all conflicting edges fit into the record.
+ */
+static bool publishExact(void *arg, const uint8_t *colour, int conflicts){
+    const exactpart_t *ctx=arg;
+    edgelist_t solution;
+    bool published=true;
+
+    solution.list=malloc(ctx->gen->maxEdges*sizeof(edges_t));
+    if(solution.list == NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    if(improvePart(ctx->gen, ctx->part, colour, conflicts, &solution)) published=publish(ctx->gen, &solution);
+    free(solution.list);
+    return published;
+}
+
+
 /**
  * @details Parses command-line arguments, sets up shared memory and semaphores, 
- *        and runs the main processing loop for graph coloring until a termination
- *        signal is received or the shared buffer indicates a stop.
+ *        and runs `-t` worker threads (one by default) that colour the graph until a
+ *        termination signal is received or the shared buffer indicates a stop.
  * 
  * @param argc Argument count.
  * @param argv Argument values.
@@ -38,23 +335,92 @@ void handle_signal(int signal) {
 int main(int argc, char *argv[]) {
     
     myprog=argv[0];
-    srand((unsigned int)time(NULL));
-
-
-    if(argc < 2) usage("we need edges for the graph");
-
-    edges_t params[argc-1];
-    int i=1;
-    for(; i<argc; i++){
-        char* token = strtok(argv[i], "-");
-        params[i-1].node_from.value= strtol(token, NULL , 0) > INT_MAX ? INT_MAX : strtol(token, NULL , 0) ;
-        token = strtok(NULL, "-");
-        params[i-1].node_to.value= strtol(token, NULL , 0) > INT_MAX ? INT_MAX : strtol(token, NULL , 0) ;
-        if(strtok(NULL, "-")!=NULL) usage("too many connected nodes");
-        if(errno==ERANGE) usage("error in converting the optarg of [n]");
-    } 
-
-    
+    int opt;
+    int opt_s=0, opt_t=0, opt_a=0, opt_T=0;
+    int threads=1;
+    long number;
+    double budget=0;
+    algorithm_t alg=ALG_RANDOM;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t seed=((uint64_t)getpid() << 32) ^ (uint64_t)now.tv_sec * 1000000000ULL ^ (uint64_t)now.tv_nsec;
+
+    const char *path=NULL;
+
+    while((opt=getopt(argc, argv, "a:f:s:t:T:"))!=-1){
+        switch(opt){
+        case 'a':
+            opt_a++;
+            if(strcmp(optarg, "random")==0) alg=ALG_RANDOM;
+            else if(strcmp(optarg, "minconf")==0) alg=ALG_MINCONF;
+            else if(strcmp(optarg, "tabu")==0) alg=ALG_TABU;
+            else if(strcmp(optarg, "exact")==0) alg=ALG_EXACT;
+            else usage("-a must be minconf, tabu, random or exact");
+            break;
+        case 'f':
+            if(path!=NULL) usage("too many edge files");
+            path=optarg;
+            break;
+        case 's':
+            opt_s++;
+            errno=0;
+            seed=strtoull(optarg, NULL, 0);
+            if(errno==ERANGE) usage("error in converting the optarg of [s]");
+            break;
+        case 't':
+            opt_t++;
+            errno=0;
+            number=strtol(optarg, NULL , 0);
+            if(errno==ERANGE || number<1 || number>INT_MAX) usage("-t needs a positive number of threads");
+            threads=number;
+            break;
+        case 'T':
+            opt_T++;
+            errno=0;
+            budget=strtod(optarg, NULL);
+            if(errno==ERANGE || budget<=0) usage("-T needs a positive number of seconds");
+            break;
+        default: /* ? option */
+            usage("invalid options");
+        }
+    }
+    if(opt_s>1) usage("too many seeds");
+    if(opt_t>1) usage("too many thread counts");
+    if(opt_a>1) usage("too many algorithms");
+    if(opt_T>1) usage("too many time budgets");
+    if(opt_T && alg!=ALG_EXACT) usage("-T is the time budget of -a exact");
+
+    /* edges come from a file (text or binary, "-" is stdin) or from the arguments */
+    edgefile_t edges;
+    if(path!=NULL){
+        if(argc-optind > 0) usage("edges are given either by -f or as arguments");
+        if(!readEdges(path, &edges)) usage("the edge file is not a valid edge list");
+    }
+    else{
+        if(argc-optind < 1) usage("we need edges for the graph");
+        if(!parseEdges(argv+optind, argc-optind, &edges)) usage("an edge is two nodes, like 1-2");
+    }
+    if(edges.count > INT_MAX/2) usage("too many edges");
+
+    graph_t graph;
+    buildGraph(edges.edges, edges.count, &graph);
+    closeEdges(&edges);
+
+    /* only the 3-core counts, and each of its components is coloured on its own */
+    graph_t *parts;
+    generator_t gen = { .alg=alg };
+    gen.nparts=reduceGraph(&graph, &parts);
+    freeGraph(&graph);
+
+    /* every worker's generator is seeded from one master stream, so -s reproduces all of them */
+    rng_t master;
+    seedRandom(&master, seed);
+    worker_t *workers;
+    if(posix_memalign((void **)&workers, sizeof(worker_t), threads*sizeof(worker_t))!=0){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    int i=0, j;
 
     int shmfd = shm_open(SHM_NAME, O_RDWR, PERMISSIONS);
     if(shmfd == -1){
@@ -62,14 +428,71 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     } 
 
+    /* the supervisor chose the size of the ring, the segment is mapped as a whole */
+    struct stat st;
+    if(fstat(shmfd, &st)==-1){
+        perror("error in reading the shared memory size");
+        exit(EXIT_FAILURE);
+    }
     circularbuffer_t *circularbuffer;
-    circularbuffer=mmap(NULL,sizeof(*circularbuffer), PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
+    circularbuffer=mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
     if(circularbuffer==MAP_FAILED){
         perror("error in mapping memory");
         exit(EXIT_FAILURE);
     }
-    circularbuffer->numGen = circularbuffer->numGen +1;
-
+    gen.circularbuffer=circularbuffer;
+    gen.maxEdges=circularbuffer->maxEdges;
+    gen.missing=gen.nparts;
+    gen.total=0;
+    pthread_mutex_init(&gen.lock, NULL);
+    gen.parts=malloc((gen.nparts > 0 ? gen.nparts : 1)*sizeof(component_t));
+    if(gen.parts == NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    int largest=1;
+    for(; i<gen.nparts; i++){
+        gen.parts[i].graph=parts[i];
+        gen.parts[i].best=gen.maxEdges;
+        gen.parts[i].list=malloc(gen.maxEdges*sizeof(edges_t));
+        if(gen.parts[i].list == NULL){
+            perror("error in allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        if(parts[i].nodes>largest) largest=parts[i].nodes;
+    }
+    free(parts);
+
+    /* worker i colours the parts i, i+threads, ...; with fewer parts than workers,
+       several workers share a part */
+    for(i=0; i<threads; i++){
+        workers[i].gen=&gen;
+        seedRandom(&workers[i].rng, nextRandom(&master));
+        workers[i].nown=gen.nparts>=threads ? (gen.nparts-i+threads-1)/threads : gen.nparts>0;
+        workers[i].own=malloc((workers[i].nown > 0 ? workers[i].nown : 1)*sizeof(assignment_t));
+        workers[i].batch.hi=malloc(largest*sizeof(uint64_t));
+        workers[i].batch.lo=malloc(largest*sizeof(uint64_t));
+        workers[i].list=malloc(gen.maxEdges*sizeof(edges_t));
+        if(workers[i].own == NULL || workers[i].batch.hi == NULL || workers[i].batch.lo == NULL
+           || workers[i].list == NULL){
+            perror("error in allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        for(j=0; j<workers[i].nown; j++){
+            assignment_t *a=&workers[i].own[j];
+            a->part=&gen.parts[gen.nparts>=threads ? i+j*threads : i%gen.nparts];
+            a->colour=malloc(a->part->graph.nodes);
+            if(a->colour == NULL){
+                perror("error in allocating memory");
+                exit(EXIT_FAILURE);
+            }
+            if(alg==ALG_MINCONF || alg==ALG_TABU){
+                initSearch(&a->ls, &a->part->graph, a->colour, &workers[i].rng);
+                a->best=a->ls.best;
+                a->lastImproved=0;
+            }
+        }
+    }
 
     struct sigaction sa = { .sa_handler = handle_signal };
     if(sigaction(SIGINT, &sa, NULL)==-1 || sigaction(SIGTERM, &sa, NULL)==-1){  
@@ -77,55 +500,62 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    sem_t *sem_free = sem_open(SEM_FREE, PERMISSIONS, LEN);
     sem_t *sem_used = sem_open(SEM_USED,PERMISSIONS, 0);
-    sem_t *sem_generator = sem_open(SEM_GENERATOR, PERMISSIONS, 1);
 
 
-    if (sem_free == SEM_FAILED || sem_used == SEM_FAILED || sem_generator == SEM_FAILED) {
+    if (sem_used == SEM_FAILED) {
         perror("error in opening semaphores");
         exit(EXIT_FAILURE);
     }
+    gen.sem_used=sem_used;
 
-    
-
-    while(!quit && !(circularbuffer->stop)){
-
-
-        if(sem_wait(sem_generator)==-1 && errno != EINTR){
-            perror("error in semaphore wating (generator)");
-            exit(EXIT_FAILURE);
-            break;
-        }
-        
-        edgelist_t solution=colouring(params, (argc-1));
-
-        if(solution.size<MAX_EDGES){
-            if(sem_wait(sem_free)==-1 && errno !=EINTR){
-                perror("error in semaphore wating (generator)");
-                exit(EXIT_FAILURE);
-                break;
+    if(gen.nparts==0){
+        /* nothing is left of the graph, every node could be coloured without a conflict */
+        edges_t none[1];
+        edgelist_t solution = { .size=0, .list=none };
+        if(improves(circularbuffer, 0)) publish(&gen, &solution);
+    }
+    else if(alg==ALG_EXACT){
+        /* the exact search has threads of its own, so the parts are searched one after
+           the other; once every part ran to the end, the bound is proved, which the
+           supervisor is told */
+        struct timespec start, now;
+        bool proven=true;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(i=0; i<gen.nparts && proven; i++){
+            exactpart_t ctx = { .gen=&gen, .part=&gen.parts[i] };
+            double left=budget;
+            if(budget>0){
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                left-=(now.tv_sec-start.tv_sec)+(now.tv_nsec-start.tv_nsec)/1e9;
+                if(left<=0){
+                    proven=false;
+                    break;
+                }
             }
-        
-            circularbuffer->solution[circularbuffer->write_pos]=solution;
-            circularbuffer->write_pos=(circularbuffer->write_pos+1) % (LEN);
-            
-
-            if(sem_post(sem_used)==-1){
-                perror("error in semaphore posting (generator)");
+            proven=exactSearch(&ctx.part->graph, threads, left, &ctx.part->best, &circularbuffer->stop, publishExact, &ctx);
+        }
+        if(proven){
+            __atomic_store_n(&circularbuffer->proven, true, __ATOMIC_RELEASE);
+            sem_post(sem_used);
+        }
+    }
+    else{
+        /* the colourings of all workers are computed in parallel, only the record
+           reservation is shared */
+        for(i=0; i<threads; i++){
+            if(pthread_create(&workers[i].tid, NULL, work, &workers[i])!=0){
+                perror("error in creating worker thread");
                 exit(EXIT_FAILURE);
-                break;
             }
         }
-        if(sem_post(sem_generator)==-1){
-            perror("error in semaphore posting (generator)");
-            exit(EXIT_FAILURE);
-            break;
-        }      
+        for(i=0; i<threads; i++){
+            pthread_join(workers[i].tid, NULL);
+        }
     }
     
     /* CLEAN UP */
-    if(munmap(circularbuffer, sizeof(*circularbuffer))==-1){
+    if(munmap(circularbuffer, st.st_size)==-1){
         perror("error in unmapping memory");
         exit(EXIT_FAILURE);
     }
@@ -135,11 +565,28 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if(sem_close(sem_free)==-1 || sem_close(sem_used)==-1 || sem_close(sem_generator)==-1){
+    if(sem_close(sem_used)==-1){
         perror("error in closing semaphores");
         exit(EXIT_FAILURE);
     }
 
+    for(i=0; i<threads; i++){
+        for(j=0; j<workers[i].nown; j++){
+            if(alg==ALG_MINCONF || alg==ALG_TABU) freeSearch(&workers[i].own[j].ls);
+            free(workers[i].own[j].colour);
+        }
+        free(workers[i].own);
+        free(workers[i].batch.hi);
+        free(workers[i].batch.lo);
+        free(workers[i].list);
+    }
+    free(workers);
+    for(i=0; i<gen.nparts; i++){
+        freeGraph(&gen.parts[i].graph);
+        free(gen.parts[i].list);
+    }
+    free(gen.parts);
+    pthread_mutex_destroy(&gen.lock);
 
     exit(EXIT_SUCCESS);
 }
@@ -153,80 +600,166 @@ int main(int argc, char *argv[]) {
  * @param errormsg Custom error message to display.
  */
 void usage(char* errormsg) {
-    fprintf(stderr, "Usage: %s , errormessage: %s\n",myprog, errormsg);
+    fprintf(stderr, "Usage: %s [-a minconf|tabu|random|exact] [-s seed] [-t threads] [-T seconds] -f file | EDGE1 ..., errormessage: %s\n",myprog, errormsg);
     exit(EXIT_FAILURE);
 }
 
 /**
- * @brief Generates a 3-color solution for the graph based on input edges.
- *
- * @details The function initializes each node’s color, then attempts to color each node
- * such that adjacent nodes have different colors. It returns an `edgelist_t` containing
- * edges that fail to meet the 3-coloring criteria.
- *
- * @param params Array of edges representing the graph.
- * @param size Number of edges in the `params` array.
- * @return edgelist_t List of edges that do not meet the 3-coloring condition.
+ * @brief Seeds the generator with splitmix64, which never yields the all-zero state.
  */
-edgelist_t colouring(edges_t params[], int size){
-
+void seedRandom(rng_t *rng, uint64_t seed){
     int i=0;
-    for(; i<size; i++){
-        params[i].node_from.colour=-1;
-        params[i].node_to.colour=-1;
-    } 
+    for(; i<4; i++){
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        rng->s[i] = z ^ (z >> 31);
+    }
+}
 
-    i=0;
-    for(; i< size; i++){
-        if(params[i].node_from.colour==-1 && params[i].node_to.colour==-1){
-            params[i].node_from.colour=rand() % 3;
-            params[i].node_to.colour= rand() % 3;
-        }   
-        if(params[i].node_from.colour==-1){
-            params[i].node_from.colour = rand() % 3;
-        }
-        if(params[i].node_to.colour==-1){
-            params[i].node_to.colour =  rand() % 3;
-        } 
-
-        int j=i+1;
-        for(; j<size; j++){
-            if(params[i].node_from.value==params[j].node_from.value){
-                params[j].node_from.colour=params[i].node_from.colour;
-            }
-            if(params[i].node_to.value==params[j].node_to.value){
-                params[j].node_to.colour=params[i].node_to.colour;
-            }
-            if(params[i].node_from.value==params[j].node_to.value){
-                params[j].node_to.colour=params[i].node_from.colour;
-            }
-            if(params[i].node_to.value==params[j].node_from.value){
-                params[j].node_from.colour=params[i].node_to.colour;
+static inline uint64_t rotl(uint64_t x, int k){
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief xoshiro256** step.
+ */
+uint64_t nextRandom(rng_t *rng){
+    uint64_t *s = rng->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+/**
+ * @brief Gives every node a uniformly random colour.
+ *
+ * @details Colours are taken 2 bits at a time from one 64-bit draw, the value 3 is
+ * skipped.
+ */
+void randomColours(uint8_t *colour, int nodes, rng_t *rng){
+    uint64_t bits=0;
+    int left=0;
+    int u=0;
+
+    for(; u<nodes; u++){
+        unsigned c;
+        do{
+            if(left==0){
+                bits=nextRandom(rng);
+                left=32;
             }
-        }
+            c=bits & 3;
+            bits>>=2;
+            left--;
+        }while(c==3);
+        colour[u]=c;
     }
- 
+}
 
-    int counter=0;
-    i=0;
-    for(; i < size; i++){
-        if(params[i].node_from.colour==params[i].node_to.colour){
-            counter++;
+/**
+ * @brief Collects the edges whose nodes share a colour.
+ *
+ * @details Every edge is visited once through the adjacency of its smaller endpoint (a
+ * self-loop through its only entry). A solution with `limit` or more conflicting edges is
+ * never written to the buffer, so the scan stops as soon as that many are found.
+ */
+int conflictingEdges(const graph_t *graph, const uint8_t *colour, edges_t *list, int limit){
+    int u=0, size=0;
+
+    for(; u<graph->nodes; u++){
+        int k=graph->offsets[u];
+        for(; k<graph->offsets[u+1]; k++){
+            int v=graph->adj[k];
+            if(v<u || colour[u]!=colour[v]) continue;
+            list[size].node_from.value=graph->values[u];
+            list[size].node_to.value=graph->values[v];
+            if(++size==limit) return size;
         }
     }
+    return size;
+}
 
+/**
+ * @brief Draws bit-sliced colourings and counts their conflicts.
+ *
+ * @details Colour 3 does not exist; lanes that drew it draw again until none is left, so
+ * every colour stays uniformly distributed. An edge conflicts in all lanes in which both
+ * nodes agree on both bits, `~((hi[u]^hi[v]) | (lo[u]^lo[v]))`. The conflict counts are
+ * bit-sliced counter words, just enough of them that the top one stands for at least
+ * `limit`; a lane that sets the top bit is not counted further, and once every lane is
+ * there the batch is given up.
+ */
+int colouringBatch(const graph_t *graph, batch_t *batch, rng_t *rng, int limit, int *lane, int *solutions){
+    uint64_t count[32] = { 0 };
+    int u=0, l=0, fewest=limit, top=0;
+
+    while(top<31 && (1L << top) < limit) top++;
+
+    for(; u<graph->nodes; u++){
+        uint64_t hi=nextRandom(rng), lo=nextRandom(rng);
+        uint64_t three=hi & lo;
+        while(three!=0){
+            hi=(hi & ~three) | (nextRandom(rng) & three);
+            lo=(lo & ~three) | (nextRandom(rng) & three);
+            three=hi & lo;
+        }
+        batch->hi[u]=hi;
+        batch->lo[u]=lo;
+    }
 
-    edgelist_t writeToBuffer;
-    writeToBuffer.size=counter;
+    for(u=0; u<graph->nodes; u++){
+        int k=graph->offsets[u];
+        for(; k<graph->offsets[u+1]; k++){
+            int v=graph->adj[k];
+            if(v<u) continue;
+            /* add 1 in every conflicting lane that has not saturated yet */
+            uint64_t carry=~((batch->hi[u] ^ batch->hi[v]) | (batch->lo[u] ^ batch->lo[v])) & ~count[top];
+            int bit=0;
+            for(; bit<=top && carry!=0; bit++){
+                uint64_t next=count[bit] & carry;
+                count[bit]^=carry;
+                carry=next;
+            }
+        }
+        if(count[top]==~0ULL){
+            *solutions=0;
+            return limit;
+        }
+    }
 
-    counter=0;
-    i=0;
-    for(; i < size && counter < MAX_EDGES; i++){
-        if(params[i].node_from.colour==params[i].node_to.colour){
-            writeToBuffer.list[counter].node_from=params[i].node_from;
-            writeToBuffer.list[counter].node_to= params[i].node_to;
-            counter++;
+    *solutions=0;
+    for(; l<BATCH; l++){
+        int conflicts=0, bit=0;
+        if(count[top]>>l & 1) continue;
+        for(; bit<top; bit++) conflicts|=(int)(count[bit]>>l & 1)<<bit;
+        if(conflicts>=limit) continue;
+        ++*solutions;
+        if(conflicts<fewest){
+            fewest=conflicts;
+            *lane=l;
         }
     }
-    return writeToBuffer;
-}
\ No newline at end of file
+    return fewest;
+}
+
+/**
+ * @brief Reads one lane out of the bit-planes of a batch.
+ *
+ * @details Bit `lane` of `hi[u]` and of `lo[u]` are the high and the low bit of the colour
+ * of node `u` in that colouring, so the colour is `hi << 1 | lo`, always 0, 1 or 2 since
+ * `colouringBatch()` redraws colour 3.
+ */
+void batchColours(const graph_t *graph, const batch_t *batch, int lane, uint8_t *colour){
+    int u=0;
+    for(; u<graph->nodes; u++){
+        colour[u]=(batch->hi[u]>>lane & 1)<<1 | (batch->lo[u]>>lane & 1);
+    }
+}
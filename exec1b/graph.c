@@ -0,0 +1,378 @@
+#include "common.h"
+
+
+/**
+ * @file graph.c
+ * @author Phillip Sassmann
+ * @date 12.11.2024
+ *
+ * @brief Reading the edges of a graph, building its adjacency and reducing it for the
+ *        generator.
+ *
+ * @details Edges come from the command line, from a text file or stdin with the same
+ * `a-b` tokens separated by white space, or from a binary edge list (`EDGEFILE_MAGIC`)
+ * that is mapped and used without parsing.
+ */
+
+
+/**
+ * @brief Parses one `a-b` edge.
+ *
+ * @param token Start of the edge.
+ * @param end Receives the first character after the edge.
+ * @param edge Receives the edge.
+ * @return false if `token` does not start with an edge.
+ */
+static bool parseEdge(const char *token, char **end, edges_t *edge){
+    long from, to;
+
+    errno=0;
+    from=strtol(token, end, 10);
+    if(*end==token || **end!='-' || errno==ERANGE || from<INT_MIN || from>INT_MAX) return false;
+    token=*end+1;
+    to=strtol(token, end, 10);
+    if(*end==token || errno==ERANGE || to<INT_MIN || to>INT_MAX) return false;
+    edge->node_from.value=from;
+    edge->node_to.value=to;
+    return true;
+}
+
+
+/**
+ * @brief Appends an edge to a growing array.
+ */
+static void addEdge(edgefile_t *file, size_t *cap, const edges_t *edge){
+    if(file->count==*cap){
+        *cap= *cap>0 ? 2 * *cap : 1024;
+        edges_t *grown=realloc(file->edges, *cap * sizeof(edges_t));
+        if(grown==NULL){
+            perror("error in allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        file->edges=grown;
+    }
+    file->edges[file->count++]=*edge;
+}
+
+
+bool parseEdges(char *const tokens[], int count, edgefile_t *file){
+    size_t cap=0;
+    int i=0;
+
+    memset(file, 0, sizeof(*file));
+    for(; i<count; i++){
+        edges_t edge;
+        char *end;
+        if(!parseEdge(tokens[i], &end, &edge) || *end!='\0') return false;
+        addEdge(file, &cap, &edge);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Reads everything from `in` into one NUL-terminated buffer.
+ */
+static char *readAll(FILE *in){
+    size_t len=0, cap=1 << 16, n;
+    char *buf=malloc(cap);
+
+    if(buf==NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    while((n=fread(buf+len, 1, cap-len-1, in))>0){
+        len+=n;
+        if(cap-len-1==0){
+            char *grown=realloc(buf, 2*cap);
+            if(grown==NULL){
+                perror("error in allocating memory");
+                exit(EXIT_FAILURE);
+            }
+            buf=grown;
+            cap*=2;
+        }
+    }
+    buf[len]='\0';
+    return buf;
+}
+
+
+/**
+ * @brief Reads a graph file; a binary edge list is mapped, text is parsed.
+ *
+ * @details A binary edge list starts with `EDGEFILE_MAGIC`, followed by the number of
+ * edges as a `uint64_t` and the edges as pairs of `int32_t`, in the byte order of the
+ * machine. That is the layout of `edges_t`, so the mapping is used as the edge array.
+ */
+bool readEdges(const char *path, edgefile_t *file){
+    FILE *in= strcmp(path, "-")==0 ? stdin : fopen(path, "r");
+    struct stat st;
+    char *text, *p;
+    size_t cap=0;
+
+    memset(file, 0, sizeof(*file));
+    if(in==NULL) return false;
+
+    if(in!=stdin && fstat(fileno(in), &st)==0 && S_ISREG(st.st_mode) && (size_t)st.st_size>=EDGEFILE_HEADER){
+        char magic[sizeof(EDGEFILE_MAGIC)-1];
+        if(fread(magic, sizeof(magic), 1, in)==1 && memcmp(magic, EDGEFILE_MAGIC, sizeof(magic))==0){
+            uint64_t count;
+            void *map=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+            fclose(in);
+            if(map==MAP_FAILED) return false;
+            memcpy(&count, (char *)map+sizeof(magic), sizeof(count));
+            if(count>((uint64_t)st.st_size-EDGEFILE_HEADER)/sizeof(edges_t)){
+                munmap(map, st.st_size);
+                errno=EINVAL;
+                return false;
+            }
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            file->edges=(edges_t *)((char *)map+EDGEFILE_HEADER);
+            file->count=count;
+            file->map=map;
+            file->mapSize=st.st_size;
+            return true;
+        }
+        rewind(in);
+    }
+
+    text=readAll(in);
+    if(in!=stdin) fclose(in);
+    for(p=text; ; ){
+        edges_t edge;
+        char *end;
+        while(isspace((unsigned char)*p)) p++;
+        if(*p=='\0') break;
+        if(!parseEdge(p, &end, &edge) || (*end!='\0' && !isspace((unsigned char)*end))){
+            free(text);
+            free(file->edges);
+            file->edges=NULL;
+            errno=EINVAL;
+            return false;
+        }
+        addEdge(file, &cap, &edge);
+        p=end;
+    }
+    free(text);
+    return true;
+}
+
+
+void closeEdges(edgefile_t *file){
+    if(file->map!=NULL) munmap(file->map, file->mapSize);
+    else free(file->edges);
+    file->edges=NULL;
+}
+
+
+/**
+ * @brief Compares two node values for `qsort()` and `bsearch()`.
+ */
+static int compareValues(const void *a, const void *b){
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Returns the dense ID of a node value in the sorted array of distinct values.
+ */
+static int denseId(const graph_t *graph, int value){
+    const int *found = bsearch(&value, graph->values, graph->nodes, sizeof(int), compareValues);
+    return found - graph->values;
+}
+
+/**
+ * @brief Builds the compressed sparse row adjacency of the graph.
+ *
+ * @details The distinct node values are sorted, a node's dense ID is its position in
+ * that order. The adjacency is filled with a counting pass over the edges followed by a
+ * placement pass, so building costs O(E log E) once at startup.
+ *
+ * @param params Array of edges representing the graph.
+ * @param size Number of edges in the `params` array.
+ * @param graph The graph to fill.
+ */
+void buildGraph(const edges_t *params, int size, graph_t *graph){
+    int *values = malloc(2 * (size_t)size * sizeof(int));
+    int *from = malloc((size_t)size * sizeof(int));
+    int *to = malloc((size_t)size * sizeof(int));
+    int i=0, nodes=0;
+
+    if(values == NULL || from == NULL || to == NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    for(; i<size; i++){
+        values[2*i] = params[i].node_from.value;
+        values[2*i+1] = params[i].node_to.value;
+    }
+    qsort(values, 2*size, sizeof(int), compareValues);
+    for(i=0; i<2*size; i++){
+        if(i == 0 || values[i] != values[nodes-1]) values[nodes++] = values[i];
+    }
+    graph->nodes = nodes;
+    graph->values = values;
+
+    graph->offsets = calloc(nodes + 1, sizeof(int));
+    if(graph->offsets == NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    for(i=0; i<size; i++){
+        from[i] = denseId(graph, params[i].node_from.value);
+        to[i] = denseId(graph, params[i].node_to.value);
+        graph->offsets[from[i]+1]++;
+        if(from[i] != to[i]) graph->offsets[to[i]+1]++;
+    }
+    for(i=0; i<nodes; i++) graph->offsets[i+1] += graph->offsets[i];
+
+    graph->adj = malloc((graph->offsets[nodes] > 0 ? graph->offsets[nodes] : 1) * sizeof(int));
+    if(graph->adj == NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    /* offsets[u] is used as the fill position of u and restored afterwards */
+    for(i=0; i<size; i++){
+        graph->adj[graph->offsets[from[i]]++] = to[i];
+        if(from[i] != to[i]) graph->adj[graph->offsets[to[i]]++] = from[i];
+    }
+    for(i=nodes; i>0; i--) graph->offsets[i] = graph->offsets[i-1];
+    graph->offsets[0] = 0;
+
+    free(from);
+    free(to);
+}
+
+void freeGraph(graph_t *graph){
+    free(graph->values);
+    free(graph->offsets);
+    free(graph->adj);
+}
+
+
+/**
+ * @details A node with fewer than three neighbours always has a colour left that none
+ * of them has, so it can be coloured last without a conflict; removing it may leave
+ * more such nodes. What remains is the 3-core, and only its conflicts count. A node
+ * with a self-loop stays, its loop conflicts in every colouring. Neighbours are counted
+ * with their duplicate edges. The nodes of a part keep the order of their IDs, so
+ * `values` stays sorted.
+ */
+int reduceGraph(const graph_t *graph, graph_t **parts){
+    int n=graph->nodes, u=0, count=0, head=0, tail=0;
+    int *degree=malloc(n * sizeof(int));
+    int *queue=malloc(n * sizeof(int));
+    int *part=malloc(n * sizeof(int));
+    int *local=malloc(n * sizeof(int));
+    bool *loop=calloc(n, sizeof(bool));
+
+    if(degree == NULL || queue == NULL || part == NULL || local == NULL || loop == NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+
+    /* peel: part[u] is -2 once u is removed, -1 while it belongs to no part yet */
+    for(; u<n; u++){
+        int k=graph->offsets[u];
+        degree[u]=0;
+        part[u]=-1;
+        for(; k<graph->offsets[u+1]; k++){
+            if(graph->adj[k]==u) loop[u]=true;
+            else degree[u]++;
+        }
+        if(degree[u]<3 && !loop[u]){
+            part[u]=-2;
+            queue[tail++]=u;
+        }
+    }
+    while(head<tail){
+        int v=queue[head++], k=graph->offsets[v];
+        for(; k<graph->offsets[v+1]; k++){
+            int w=graph->adj[k];
+            if(part[w]==-2 || --degree[w]>=3 || loop[w]) continue;
+            part[w]=-2;
+            queue[tail++]=w;
+        }
+    }
+
+    /* split the rest into connected components, the queue is reused */
+    for(u=0; u<n; u++){
+        if(part[u]!=-1) continue;
+        head=tail=0;
+        part[u]=count;
+        queue[tail++]=u;
+        while(head<tail){
+            int v=queue[head++], k=graph->offsets[v];
+            for(; k<graph->offsets[v+1]; k++){
+                int w=graph->adj[k];
+                if(part[w]!=-1) continue;
+                part[w]=count;
+                queue[tail++]=w;
+            }
+        }
+        count++;
+    }
+
+    *parts=calloc(count > 0 ? count : 1, sizeof(graph_t));
+    if(*parts == NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    for(u=0; u<n; u++){
+        if(part[u]>=0) local[u]=(*parts)[part[u]].nodes++;
+    }
+    for(u=0; u<count; u++){
+        graph_t *g=&(*parts)[u];
+        g->values=malloc(g->nodes * sizeof(int));
+        g->offsets=calloc(g->nodes + 1, sizeof(int));
+        if(g->values == NULL || g->offsets == NULL){
+            perror("error in allocating memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(u=0; u<n; u++){
+        graph_t *g;
+        int k=graph->offsets[u];
+        if(part[u]<0) continue;
+        g=&(*parts)[part[u]];
+        g->values[local[u]]=graph->values[u];
+        for(; k<graph->offsets[u+1]; k++){
+            if(part[graph->adj[k]]>=0) g->offsets[local[u]+1]++;
+        }
+    }
+    for(u=0; u<count; u++){
+        graph_t *g=&(*parts)[u];
+        int i=0;
+        for(; i<g->nodes; i++) g->offsets[i+1]+=g->offsets[i];
+        g->adj=malloc((g->offsets[g->nodes] > 0 ? g->offsets[g->nodes] : 1) * sizeof(int));
+        if(g->adj == NULL){
+            perror("error in allocating memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+    /* offsets[v] is used as the fill position of v and restored afterwards */
+    for(u=0; u<n; u++){
+        graph_t *g;
+        int k=graph->offsets[u];
+        if(part[u]<0) continue;
+        g=&(*parts)[part[u]];
+        for(; k<graph->offsets[u+1]; k++){
+            int w=graph->adj[k];
+            if(part[w]>=0) g->adj[g->offsets[local[u]]++]=local[w];
+        }
+    }
+    for(u=0; u<count; u++){
+        graph_t *g=&(*parts)[u];
+        int i=g->nodes;
+        for(; i>0; i--) g->offsets[i]=g->offsets[i-1];
+        g->offsets[0]=0;
+    }
+
+    free(degree);
+    free(queue);
+    free(part);
+    free(local);
+    free(loop);
+    return count;
+}
@@ -0,0 +1,201 @@
+#include "common.h"
+
+
+/**
+ * @file localsearch.c
+ * @author Phillip Sassmann
+ * @date 12.11.2024
+ *
+ * @brief Local search engines of the generator: min-conflicts and tabu search.
+ *
+ * @details Instead of throwing every colouring away, both engines keep one colouring and
+ * recolour a single conflicting node per step. The neighbour colour counts in
+ * `localsearch_t` make every step cost O(degree) for the move itself; tabu search also
+ * looks at the colour counts of all conflicting nodes to pick the best move.
+ */
+
+
+/** Probability with which min-conflicts moves a node to a random other colour. */
+#define NOISE 0.1
+/** Fixed part of the tabu tenure, a random part below this is added. */
+#define TENURE 10
+
+
+/**
+ * @brief Returns a random number below `n`.
+ */
+static int randomBelow(rng_t *rng, int n){
+    return (int)(nextRandom(rng) % (uint64_t)n);
+}
+
+
+/**
+ * @brief Adds `u` to or removes it from the list of conflicting nodes, as needed.
+ */
+static void updateConflicting(localsearch_t *ls, int u){
+    bool conflicting = ls->conf[3*u+ls->colour[u]] > 0;
+
+    if(conflicting && ls->where[u] == -1){
+        ls->where[u] = ls->nconflicting;
+        ls->conflicting[ls->nconflicting++] = u;
+    }
+    else if(!conflicting && ls->where[u] != -1){
+        int last = ls->conflicting[--ls->nconflicting];
+        ls->conflicting[ls->where[u]] = last;
+        ls->where[last] = ls->where[u];
+        ls->where[u] = -1;
+    }
+}
+
+
+/**
+ * @brief Gives node `u` colour `c` and updates the counts of its neighbours.
+ */
+static void move(localsearch_t *ls, int u, int c){
+    const graph_t *graph = ls->graph;
+    int old = ls->colour[u];
+    int k = graph->offsets[u];
+
+    ls->conflicts += ls->conf[3*u+c] - ls->conf[3*u+old];
+    ls->colour[u] = c;
+    for(; k<graph->offsets[u+1]; k++){
+        int v = graph->adj[k];
+        if(v == u) continue;
+        ls->conf[3*v+old]--;
+        ls->conf[3*v+c]++;
+        updateConflicting(ls, v);
+    }
+    updateConflicting(ls, u);
+    if(ls->conflicts < ls->best) ls->best = ls->conflicts;
+}
+
+
+void initSearch(localsearch_t *ls, const graph_t *graph, uint8_t *colour, rng_t *rng){
+    ls->graph = graph;
+    ls->colour = colour;
+    ls->conf = malloc(3 * (size_t)graph->nodes * sizeof(int));
+    ls->conflicting = malloc(graph->nodes * sizeof(int));
+    ls->where = malloc(graph->nodes * sizeof(int));
+    ls->tabu = malloc(3 * (size_t)graph->nodes * sizeof(long));
+    if(ls->conf == NULL || ls->conflicting == NULL || ls->where == NULL || ls->tabu == NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    restartSearch(ls, rng);
+}
+
+
+/**
+ * @brief Draws a random colouring and counts its conflicts in O(V+E).
+ */
+void restartSearch(localsearch_t *ls, rng_t *rng){
+    const graph_t *graph = ls->graph;
+    int u = 0;
+    long twice = 0;
+
+    randomColours(ls->colour, graph->nodes, rng);
+    memset(ls->conf, 0, 3 * (size_t)graph->nodes * sizeof(int));
+    memset(ls->tabu, 0, 3 * (size_t)graph->nodes * sizeof(long));
+    ls->selfLoops = 0;
+    ls->nconflicting = 0;
+    ls->step = 0;
+    for(; u<graph->nodes; u++){
+        int k = graph->offsets[u];
+        for(; k<graph->offsets[u+1]; k++){
+            int v = graph->adj[k];
+            if(v == u) ls->selfLoops++;
+            else ls->conf[3*u+ls->colour[v]]++;
+        }
+    }
+    for(u=0; u<graph->nodes; u++){
+        twice += ls->conf[3*u+ls->colour[u]];
+        ls->where[u] = -1;
+        updateConflicting(ls, u);
+    }
+    ls->conflicts = twice/2 + ls->selfLoops;
+    ls->best = ls->conflicts;
+}
+
+
+/**
+ * @brief Min-conflicts step: a random conflicting node gets the colour with the fewest
+ * neighbours of that colour, ties broken at random, so it may keep its colour. With
+ * probability `NOISE` it gets a random other colour instead, which leads out of local
+ * minima.
+ */
+static void minConflictsStep(localsearch_t *ls, rng_t *rng){
+    int u = ls->conflicting[randomBelow(rng, ls->nconflicting)];
+    int cur = ls->colour[u];
+    int c = 0, best = cur, ties = 0;
+
+    if((nextRandom(rng) >> 11) * (1.0 / 9007199254740992.0) < NOISE){
+        move(ls, u, (cur + 1 + randomBelow(rng, 2)) % 3);
+        return;
+    }
+    for(; c<3; c++){
+        if(ties == 0 || ls->conf[3*u+c] < ls->conf[3*u+best]){
+            best = c;
+            ties = 1;
+        }
+        else if(ls->conf[3*u+c] == ls->conf[3*u+best] && randomBelow(rng, ++ties) == 0){
+            best = c;
+        }
+    }
+    if(best != cur) move(ls, u, best);
+}
+
+
+/**
+ * @brief Tabu step: the best move of any conflicting node to another colour that is not
+ * tabu, or that is tabu but reaches fewer conflicts than ever seen (aspiration). The
+ * old colour of the node becomes tabu for a tenure that grows with the conflicts left.
+ */
+static void tabuStep(localsearch_t *ls, rng_t *rng){
+    int bestDelta = INT_MAX, ties = 0;
+    int bestNode = -1, bestColour = 0;
+    int i = 0;
+
+    for(; i<ls->nconflicting; i++){
+        int u = ls->conflicting[i];
+        int cur = ls->colour[u];
+        int c = 0;
+        for(; c<3; c++){
+            int delta = ls->conf[3*u+c] - ls->conf[3*u+cur];
+            if(c == cur) continue;
+            if(ls->tabu[3*u+c] > ls->step && ls->conflicts+delta >= ls->best) continue;
+            if(delta < bestDelta){
+                bestDelta = delta;
+                ties = 1;
+                bestNode = u;
+                bestColour = c;
+            }
+            else if(delta == bestDelta && randomBelow(rng, ++ties) == 0){
+                bestNode = u;
+                bestColour = c;
+            }
+        }
+    }
+    if(bestNode == -1){
+        /* every move is tabu */
+        bestNode = ls->conflicting[randomBelow(rng, ls->nconflicting)];
+        bestColour = (ls->colour[bestNode] + 1 + randomBelow(rng, 2)) % 3;
+    }
+    ls->tabu[3*bestNode+ls->colour[bestNode]] = ls->step + TENURE + (long)(0.6 * ls->nconflicting) + randomBelow(rng, TENURE);
+    move(ls, bestNode, bestColour);
+}
+
+
+void searchStep(localsearch_t *ls, algorithm_t alg, rng_t *rng){
+    if(ls->nconflicting == 0) return;
+    if(alg == ALG_TABU) tabuStep(ls, rng);
+    else minConflictsStep(ls, rng);
+    ls->step++;
+}
+
+
+void freeSearch(localsearch_t *ls){
+    free(ls->conf);
+    free(ls->conflicting);
+    free(ls->where);
+    free(ls->tabu);
+}
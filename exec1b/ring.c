@@ -0,0 +1,40 @@
+#include "common.h"
+
+
+/**
+ * @file ring.c
+ * @author Phillip Sassmann
+ * @date 12.11.2024
+ *
+ * @brief Copying records into and out of the ring of the shared segment.
+ *
+ * @details A record may wrap around the end of the ring, these functions split such a
+ * copy in two.
+ */
+
+
+void ringWrite(circularbuffer_t *circularbuffer, uint64_t pos, const void *src, size_t len){
+    size_t at=pos % circularbuffer->capacity;
+    size_t first= len < circularbuffer->capacity-at ? len : circularbuffer->capacity-at;
+
+    memcpy(circularbuffer->ring+at, src, first);
+    memcpy(circularbuffer->ring, (const char *)src+first, len-first);
+}
+
+
+void ringRead(const circularbuffer_t *circularbuffer, uint64_t pos, void *dst, size_t len){
+    size_t at=pos % circularbuffer->capacity;
+    size_t first= len < circularbuffer->capacity-at ? len : circularbuffer->capacity-at;
+
+    memcpy(dst, circularbuffer->ring+at, first);
+    memcpy((char *)dst+first, circularbuffer->ring, len-first);
+}
+
+
+void ringClear(circularbuffer_t *circularbuffer, uint64_t pos, size_t len){
+    size_t at=pos % circularbuffer->capacity;
+    size_t first= len < circularbuffer->capacity-at ? len : circularbuffer->capacity-at;
+
+    memset(circularbuffer->ring+at, 0, first);
+    memset(circularbuffer->ring, 0, len-first);
+}
@@ -43,22 +43,41 @@ int main(int argc,char *argv[]){
     myprog=argv[0];
     int opt;
     int limit=INT_MAX, delay=0;  
-    int opt_n=0, opt_w=0;
-    int num_solutions=0;
+    int opt_n=0, opt_w=0, opt_b=0, opt_e=0;
     int bestRemovedEdges=INT_MAX;
+    int maxEdges=MAX_EDGES;
+    long number;
+    long bytes=RING_BYTES;
 
 
-    while((opt=getopt(argc, argv, "n:w:"))!=-1){
+    while((opt=getopt(argc, argv, "n:w:b:e:"))!=-1){
         switch(opt){
         case 'n':
             opt_n++;
-            limit=strtol(optarg, NULL , 0) > INT_MAX ? INT_MAX : strtol(optarg, NULL , 0) ;
-            if(errno==ERANGE) usage("error in converting the optarg of [n]");
+            errno=0;
+            number=strtol(optarg, NULL , 0);
+            if(errno==ERANGE || number<0 || number>INT_MAX) usage("-n needs a non-negative number of solutions");
+            limit=number;
             break;
         case 'w':
             opt_w++;
-            delay=strtol(optarg, NULL , 0) > INT_MAX ? INT_MAX : strtol(optarg, NULL , 0) ;
-            if(errno==ERANGE) usage("error in converting the optarg of [w]");
+            errno=0;
+            number=strtol(optarg, NULL , 0);
+            if(errno==ERANGE || number<0 || number>INT_MAX) usage("-w needs a non-negative delay in seconds");
+            delay=number;
+            break;
+        case 'b':
+            opt_b++;
+            errno=0;
+            bytes=strtol(optarg, NULL , 0);
+            if(errno==ERANGE || bytes<1) usage("-b needs a positive ring size in bytes");
+            break;
+        case 'e':
+            opt_e++;
+            errno=0;
+            number=strtol(optarg, NULL , 0);
+            if(errno==ERANGE || number<1 || number>INT_MAX/2) usage("-e needs a positive number of edges");
+            maxEdges=number;
             break;
         default: /* ? option */
             usage("invalid options");
@@ -72,19 +91,34 @@ int main(int argc,char *argv[]){
         usage("too many delays defined");
     }
 
+    if(opt_b>1){
+        usage("too many ring sizes defined");
+    }
+
+    if(opt_e>1){
+        usage("too many edge limits defined");
+    }
+
+    /* records are multiples of 8 bytes, the ring has to hold the largest one */
+    uint64_t capacity=(uint64_t)(bytes+7) & ~(uint64_t)7;
+    if(capacity<RECORD_SIZE(maxEdges)){
+        usage("the ring is too small for a solution of -e edges");
+    }
+    size_t shmSize=sizeof(circularbuffer_t)+capacity;
+
     int shmfd = shm_open(SHM_NAME, O_RDWR| O_CREAT, PERMISSIONS);
     if(shmfd == -1){
         perror("error in opening shared memory");
         exit(EXIT_FAILURE);
     } 
 
-    if(ftruncate(shmfd, sizeof(circularbuffer_t))==-1){
+    if(ftruncate(shmfd, shmSize)==-1){
         perror("error in sizing memory ");
         exit(EXIT_FAILURE);
     }
 
     circularbuffer_t *circularbuffer;
-    circularbuffer=mmap(NULL, sizeof(*circularbuffer), PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
+    circularbuffer=mmap(NULL, shmSize, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
     if(circularbuffer==MAP_FAILED){
         perror("error in mapping memory");
         exit(EXIT_FAILURE);
@@ -98,39 +132,65 @@ int main(int argc,char *argv[]){
     }
  
 
-    sem_t *sem_free = sem_open(SEM_FREE, O_CREAT | O_EXCL , PERMISSIONS, LEN);
     sem_t *sem_used = sem_open(SEM_USED, O_CREAT | O_EXCL , PERMISSIONS, 0);
-    sem_t *sem_generator = sem_open(SEM_GENERATOR, O_CREAT | O_EXCL, PERMISSIONS, 1);
         
-    if (sem_free == SEM_FAILED || sem_used == SEM_FAILED || sem_generator == SEM_FAILED) {
+    if (sem_used == SEM_FAILED) {
         perror("error in opening semaphores");
         exit(EXIT_FAILURE);
     }
 
     circularbuffer->stop =false;
+    circularbuffer->proven =false;
     circularbuffer->read_pos =0;
     circularbuffer->write_pos =0;
-    circularbuffer->numGen =0;
+    circularbuffer->limit =limit;
+    circularbuffer->maxEdges =maxEdges;
+    circularbuffer->capacity =capacity;
+    circularbuffer->best =maxEdges;
+    circularbuffer->candidates =0;
+
+    /* ftruncate zero-filled the ring, so no record is ready yet */
+    edges_t *list=malloc(maxEdges*sizeof(edges_t));
+    if(list==NULL){
+        perror("error in allocating memory");
+        exit(EXIT_FAILURE);
+    }
 
     sleep(delay);
 
-    while (!quit && num_solutions<=limit ) {
+    /* generators only publish improvements and stop the run at the solution limit */
+    while (!quit) {
 
-        if(sem_wait(sem_used)==-1 && errno != EINTR){
+        if(sem_wait(sem_used)==-1){
+            if(errno == EINTR) continue;
             perror("error in semaphore wating (supervisor)");
             exit(EXIT_FAILURE);
-            break;
         }
 
-        //Read solution from buffer
-        edgelist_t solution=circularbuffer->solution[circularbuffer->read_pos];
-        circularbuffer->read_pos=(circularbuffer->read_pos+1) % (LEN);
+        //Read the next record from the ring, once the generator that reserved it has set ready;
+        //a generator that stopped the run or proved the best bound posts SEM_USED without publishing anything
+        uint64_t pos=circularbuffer->read_pos;
+        uint32_t *ready=(uint32_t *)(circularbuffer->ring + pos % capacity);
+        bool stopped=false;
+        while(__atomic_load_n(ready, __ATOMIC_ACQUIRE)==0){
+            if((stopped=quit || __atomic_load_n(&circularbuffer->stop, __ATOMIC_ACQUIRE)
+                        || __atomic_load_n(&circularbuffer->proven, __ATOMIC_ACQUIRE))) break;
+            sched_yield();
+        }
+        if(stopped) break;
+        record_t header;
+        ringRead(circularbuffer, pos, &header, sizeof(header));
+        edgelist_t solution = { .size=header.size, .list=list };
+        size_t len=RECORD_SIZE(solution.size);
+        ringRead(circularbuffer, pos+sizeof(header), list, len-sizeof(header));
+        /* the next generator to write here finds the ready flag cleared */
+        ringClear(circularbuffer, pos, len);
+        __atomic_store_n(&circularbuffer->read_pos, pos+len, __ATOMIC_RELEASE);
 
         if(solution.size==0){
             bestRemovedEdges=0;
             fprintf(stdout,"The graph is 3-colorable!\n");
             quit=1;
-            circularbuffer->stop;
         }
 
         if(solution.size < bestRemovedEdges){
@@ -138,29 +198,31 @@ int main(int argc,char *argv[]){
             //printf("Solution with %d edges: ",bestRemovedEdges);
             //printEdges(solution);
         }
-
-        num_solutions++;
-
-        if(sem_post(sem_free)==-1){
-            perror("error in semaphore posting (supervisor)");
-            exit(EXIT_FAILURE);
-            break;
-        }
     }
     
 
-    if(bestRemovedEdges>0){
+    /* after a proof the bound is exact, even if its record has not been read yet */
+    int proven=__atomic_load_n(&circularbuffer->proven, __ATOMIC_ACQUIRE) ? circularbuffer->best : -1;
+    if(bestRemovedEdges>0 && proven==0){
+       fprintf(stdout,"The graph is 3-colorable!\n");
+    }
+    else if(bestRemovedEdges>0 && proven>0 && proven<maxEdges){
+       fprintf(stdout,"The graph is not 3-colorable, the best solution removes %d edges.\n",proven);
+    }
+    else if(bestRemovedEdges>0 && proven>0){
+       fprintf(stdout,"The graph is not 3-colorable, every solution removes at least %d edges.\n",proven);
+    }
+    else if(bestRemovedEdges>0){
        fprintf(stdout,"The graph might not be 3-colorable, best solution removes %d edges.\n",bestRemovedEdges);
     }
 
-    while(circularbuffer->numGen>0){
-        sem_post(sem_free);
-        circularbuffer->numGen=circularbuffer->numGen -1 ;
-    }
+    /* stop the generators, those waiting for space in the ring see it as well */
+    __atomic_store_n(&circularbuffer->stop, true, __ATOMIC_RELEASE);
+    free(list);
 
 
     /* CLEAN UP */
-    if(munmap(circularbuffer, sizeof(*circularbuffer))==-1){
+    if(munmap(circularbuffer, shmSize)==-1){
         perror("error in unmapping memory");
         exit(EXIT_FAILURE);
     }
@@ -175,11 +237,11 @@ int main(int argc,char *argv[]){
         exit(EXIT_FAILURE);
     }
 
-    if(sem_close(sem_free)==-1 || sem_close(sem_used)==-1 || sem_close(sem_generator)==-1){
+    if(sem_close(sem_used)==-1){
         perror("error in closing semaphores");
         exit(EXIT_FAILURE);
     }
-    if(sem_unlink(SEM_FREE)==-1 || sem_unlink(SEM_USED)==-1 || sem_unlink(SEM_GENERATOR)==-1){
+    if(sem_unlink(SEM_USED)==-1){
         perror("error in unlinking semaphores");
         exit(EXIT_FAILURE);
     }
@@ -197,7 +259,7 @@ int main(int argc,char *argv[]){
  * @param errormsg Custom error message to display.
  */
 void usage(char* errormsg) {
-    fprintf(stderr, "Usage: %s, supervisor [-n limit] [-w delay], errormessage: %s\n",myprog, errormsg);
+    fprintf(stderr, "Usage: %s, supervisor [-n limit] [-w delay] [-b bytes] [-e maxedges], errormessage: %s\n",myprog, errormsg);
     exit(EXIT_FAILURE);
 }
 